@@ -0,0 +1,173 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+extern "C" {
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+}
+
+#include "affinity.hpp"
+
+namespace fdinject {
+
+namespace {
+	/// Read the first line of a file, or an empty string if it can not be read.
+	std::string read_line(std::string const & path) {
+		std::ifstream file(path);
+		std::string line;
+		std::getline(file, line);
+		return line;
+	}
+
+	/// Get the allowed CPUs of a thread, or of the calling thread for pid 0.
+	cpu_set_t get_affinity(int pid) {
+		cpu_set_t mask;
+		CPU_ZERO(&mask);
+		if (sched_getaffinity(pid, sizeof(mask), &mask)) throw dbpp::error(pid, {errno, std::system_category()}, "Failed to get CPU affinity");
+		return mask;
+	}
+
+	/// Prefer memory of a NUMA node for the calling thread, or restore the default policy for a negative node.
+	long set_preferred_node(int node) {
+		if (node < 0) return ::syscall(SYS_set_mempolicy, MPOL_DEFAULT, nullptr, 0);
+		unsigned long mask[16] = {};
+		std::size_t bits = sizeof(mask) * 8;
+		if (std::size_t(node) >= bits) return -1;
+		mask[node / (sizeof(mask[0]) * 8)] |= 1ul << (node % (sizeof(mask[0]) * 8));
+		return ::syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, bits + 1);
+	}
+}
+
+/// Get the CPU a process last ran on.
+int last_cpu(int pid) {
+	std::string stat = read_line("/proc/" + std::to_string(pid) + "/stat");
+	std::size_t end_of_name = stat.rfind(')');
+	if (end_of_name == std::string::npos) throw dbpp::error(pid, std::make_error_code(std::errc::no_such_process), "Failed to read process status");
+
+	// The fields after the command name start at field 3.
+	std::istringstream stream(stat.substr(end_of_name + 1));
+	std::string field;
+	for (int i = 3; i <= 39; ++i) {
+		if (!(stream >> field)) throw dbpp::error(pid, std::make_error_code(std::errc::protocol_error), "Failed to parse process status");
+	}
+	return std::stoi(field);
+}
+
+/// Get the NUMA node of a CPU.
+int cpu_node(int cpu) {
+	DIR * directory = opendir(("/sys/devices/system/cpu/cpu" + std::to_string(cpu)).c_str());
+	if (!directory) return -1;
+	int node = -1;
+	while (dirent * entry = readdir(directory)) {
+		if (std::strncmp(entry->d_name, "node", 4) == 0 && std::isdigit(entry->d_name[4])) {
+			node = std::atoi(entry->d_name + 4);
+			break;
+		}
+	}
+	closedir(directory);
+	return node;
+}
+
+/// Parse a CPU list as used in sysfs.
+std::vector<int> parse_cpu_list(std::string const & list) {
+	std::vector<int> result;
+	std::istringstream stream(list);
+	std::string range;
+	while (std::getline(stream, range, ',')) {
+		if (range.empty()) continue;
+		std::size_t dash = range.find('-');
+		int first = std::stoi(range.substr(0, dash));
+		int last  = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+		for (int cpu = first; cpu <= last; ++cpu) result.push_back(cpu);
+	}
+	return result;
+}
+
+/// Measure the median time for a stopped target to perform a trivial system call.
+std::chrono::nanoseconds measure_round_trip(target & target, int samples) {
+	std::vector<std::chrono::nanoseconds> durations;
+	durations.reserve(samples);
+	for (int i = 0; i < samples; ++i) {
+		auto start = std::chrono::steady_clock::now();
+		target.syscall(SYS_getpid, {{0, 0, 0, 0, 0, 0}});
+		durations.push_back(std::chrono::steady_clock::now() - start);
+	}
+	if (durations.empty()) return std::chrono::nanoseconds(0);
+	std::nth_element(durations.begin(), durations.begin() + durations.size() / 2, durations.end());
+	return durations[durations.size() / 2];
+}
+
+/// Pin the calling thread close to a process.
+colocation::colocation(int pid, std::ostream * log) : old_mask(get_affinity(0)), target_cpu_(last_cpu(pid)), cpu_(-1), node_(cpu_node(target_cpu_)) {
+	cpu_set_t allowed = get_affinity(pid);
+	CPU_AND(&allowed, &allowed, &old_mask);
+	auto usable = [&] (int cpu) { return cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed); };
+
+	// Prefer a hardware thread sibling, then any CPU on the same node. Fall back to sharing the CPU of the target.
+	std::string prefix = "/sys/devices/system/cpu/cpu" + std::to_string(target_cpu_);
+	std::vector<int> candidates = parse_cpu_list(read_line(prefix + "/topology/thread_siblings_list"));
+	if (node_ >= 0) {
+		std::vector<int> node_cpus = parse_cpu_list(read_line("/sys/devices/system/node/node" + std::to_string(node_) + "/cpulist"));
+		candidates.insert(candidates.end(), node_cpus.begin(), node_cpus.end());
+	}
+	candidates.erase(std::remove(candidates.begin(), candidates.end(), target_cpu_), candidates.end());
+	candidates.push_back(target_cpu_);
+	auto choice = std::find_if(candidates.begin(), candidates.end(), usable);
+
+	// Pinning only improves latency, so the session continues unpinned if it is not possible.
+	if (choice != candidates.end()) {
+		cpu_set_t mask;
+		CPU_ZERO(&mask);
+		CPU_SET(*choice, &mask);
+		if (sched_setaffinity(0, sizeof(mask), &mask) == 0) {
+			cpu_ = *choice;
+		} else if (log) {
+			*log << "Failed to pin to CPU " << *choice << ": " << std::strerror(errno) << ".\n";
+		}
+	}
+
+	// Failing to set the memory policy only costs performance, for example on kernels without NUMA support.
+	saved_policy_ = ::syscall(SYS_get_mempolicy, &old_policy_, old_nodes_, sizeof(old_nodes_) * 8 + 1, nullptr, 0) == 0;
+	if (set_preferred_node(node_) != 0 && log) *log << "Failed to prefer memory of NUMA node " << node_ << ".\n";
+	if (!log) return;
+	if (cpu_ < 0) {
+		*log << "Process last ran on CPU " << target_cpu_ << ", not pinned, preferring NUMA node " << node_ << ".\n";
+	} else {
+		*log << "Process last ran on CPU " << target_cpu_ << ", pinned to CPU " << cpu_ << " on NUMA node " << node_ << ".\n";
+	}
+}
+
+/// Restore the original affinity and memory policy of the calling thread.
+colocation::~colocation() {
+	if (cpu_ >= 0) sched_setaffinity(0, sizeof(old_mask), &old_mask);
+	if (!saved_policy_ || ::syscall(SYS_set_mempolicy, old_policy_, old_nodes_, sizeof(old_nodes_) * 8 + 1) != 0) set_preferred_node(-1);
+}
+
+}
@@ -0,0 +1,97 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <sched.h>
+}
+
+#include "target.hpp"
+
+namespace fdinject {
+
+/// Get the CPU a process last ran on, from field 39 of /proc/<pid>/stat.
+/**
+ * Throws on failure.
+ */
+int last_cpu(int pid);
+
+/// Get the NUMA node of a CPU, or -1 if it is unknown.
+int cpu_node(int cpu);
+
+/// Parse a CPU list as used in sysfs, like "0-3,8".
+std::vector<int> parse_cpu_list(std::string const & list);
+
+/// Measure the median time for a stopped target to perform a trivial system call.
+/**
+ * Each sample resumes and stops the target twice, so this is a measure for the ptrace round trip latency.
+ * Throws on failure.
+ */
+std::chrono::nanoseconds measure_round_trip(target & target, int samples = 32);
+
+/// Pins the calling thread close to a process and prefers memory of its NUMA node, as long as it exists.
+/**
+ * The calling thread is pinned to a hardware thread sibling of the CPU the process last ran on,
+ * or else to another CPU of the same NUMA node that both may run on, or else to the CPU of the process itself.
+ * If none of those CPUs is allowed for the calling thread, it is not pinned at all.
+ * On destruction, the original affinity and memory policy are restored.
+ */
+class colocation {
+public:
+	/// Pin the calling thread close to a process.
+	/**
+	 * Failing to pin the thread or to set the memory policy is logged but not an error.
+	 * Throws if the CPU of the process can not be determined.
+	 */
+	explicit colocation(int pid, std::ostream * log = nullptr);
+
+	colocation(colocation const &) = delete;
+	colocation & operator= (colocation const &) = delete;
+
+	/// Restore the original affinity and memory policy of the calling thread.
+	~colocation();
+
+	/// The CPU the process last ran on.
+	int target_cpu() const { return target_cpu_; }
+
+	/// The CPU the calling thread is pinned to, or -1 if it is not pinned.
+	int cpu() const { return cpu_; }
+
+	/// The NUMA node of the CPU, or -1 if it is unknown.
+	int node() const { return node_; }
+
+private:
+	cpu_set_t old_mask;
+	int target_cpu_;
+	int cpu_;
+	int node_;
+
+	/// The memory policy of the calling thread before colocating.
+	bool saved_policy_;
+	int old_policy_;
+	unsigned long old_nodes_[16];
+};
+
+}
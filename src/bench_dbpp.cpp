@@ -0,0 +1,172 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+}
+
+#include "dbpp.hpp"
+#include "syscall.hpp"
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+/// Memory in the helper process to copy from and to. The helper is forked, so the address is the same in both processes.
+std::uint8_t remote_buffer[1 << 20];
+
+/// Local memory to copy from and to.
+std::uint8_t local_buffer[1 << 20];
+
+/// Block sizes for the memory copy benchmarks.
+std::size_t const copy_sizes[] = {8, 64, 512, 4096, 65536};
+
+void usage(char const * name) {
+	std::cout << "Usage: " << name << " [--iterations N]\n";
+}
+
+/// Code run by the traced helper: stop, then trap forever.
+[[noreturn]] void helper() {
+	prctl(PR_SET_PDEATHSIG, SIGKILL);
+	dbpp::trace_me();
+	raise(dbpp::sigtrap);
+	while (true) asm volatile ("int3");
+}
+
+void print_header() {
+	std::cout << std::left << std::setw(28) << "operation" << std::right;
+	for (char const * column : {"samples", "min", "p50", "p90", "p99", "max"}) std::cout << std::setw(10) << column;
+	std::cout << "    (microseconds)\n";
+}
+
+/// Time an operation a number of times after a warmup, and print percentiles of the durations.
+void measure(std::string const & name, std::size_t samples, std::function<void ()> const & setup, std::function<void ()> const & operation) {
+	for (std::size_t i = 0; i < samples / 10 + 1; ++i) {
+		setup();
+		operation();
+	}
+
+	std::vector<double> durations;
+	durations.reserve(samples);
+	for (std::size_t i = 0; i < samples; ++i) {
+		setup();
+		auto start = clock::now();
+		operation();
+		durations.push_back(std::chrono::duration<double, std::micro>(clock::now() - start).count());
+	}
+	std::sort(durations.begin(), durations.end());
+
+	auto percentile = [&] (double p) { return durations[std::min(durations.size() - 1, std::size_t(p * durations.size()))]; };
+	std::cout << std::left << std::setw(28) << name << std::right << std::setw(10) << samples << std::fixed << std::setprecision(2);
+	for (double value : {durations.front(), percentile(0.5), percentile(0.9), percentile(0.99), durations.back()}) std::cout << std::setw(10) << value;
+	std::cout << "\n";
+}
+
+void measure(std::string const & name, std::size_t samples, std::function<void ()> const & operation) {
+	measure(name, samples, [] () {}, operation);
+}
+
+void run(int pid, std::size_t iterations) {
+	std::uintptr_t remote = reinterpret_cast<std::uintptr_t>(remote_buffer);
+	std::uintptr_t code   = reinterpret_cast<std::uintptr_t>(&helper);
+	dbpp::registers_t registers = dbpp::get_registers(pid);
+
+	print_header();
+	measure("get_registers", iterations, [&] () { registers = dbpp::get_registers(pid); });
+	measure("set_registers", iterations, [&] () { dbpp::set_registers(pid, registers); });
+	measure("read_memory", iterations, [&] () { dbpp::read_memory(pid, remote); });
+	measure("write_memory", iterations, [&] () { dbpp::write_memory(pid, remote, 0); });
+
+	for (std::size_t size : copy_sizes) {
+		// Copying word by word is slow for large blocks, so scale down the number of samples.
+		std::size_t samples = std::max<std::size_t>(50, iterations * 64 / std::max<std::size_t>(size, 64));
+		std::string suffix = "(" + std::to_string(size) + ")";
+		measure("memcpy_to" + suffix, samples, [&] () { dbpp::memcpy_to(pid, remote, local_buffer, size); });
+		measure("memcpy_from" + suffix, samples, [&] () { dbpp::memcpy_from(pid, local_buffer, remote, size); });
+		measure("read_memory_bulk" + suffix, samples, [&] () { dbpp::read_memory_bulk(pid, local_buffer, remote, size); });
+	}
+
+	measure("syscall(getpid)", iterations, [&] () { dbpp::syscall(pid, SYS_getpid, {{0, 0, 0, 0, 0, 0}}); });
+
+	// Restoring a breakpoint rolls back the instruction pointer, so reset the registers before each sample.
+	measure("breakpoint set+restore", iterations, [&] () { dbpp::set_registers(pid, registers); }, [&] () { dbpp::breakpoint::set(pid, code).restore(); });
+	dbpp::set_registers(pid, registers);
+
+	measure("resume+wait_for_trap", iterations, [&] () { dbpp::resume(pid); dbpp::wait_for_trap(pid); });
+}
+
+}
+
+int main(int argc, char * * argv) {
+	std::size_t iterations = 2000;
+
+	for (int i = 1; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+			iterations = std::stoull(argv[++i]);
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (iterations == 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	try {
+		int pid = dbpp::fork();
+		if (pid == 0) helper();
+
+		// Skip the initial stop, then wait for the helper to trap in its loop.
+		// dbpp::syscall() needs PTRACE_O_TRACESYSGOOD to recognize system call stops.
+		dbpp::wait_for_trap(pid);
+		dbpp::set_options(pid, PTRACE_O_TRACESYSGOOD);
+		dbpp::resume(pid);
+		dbpp::wait_for_trap(pid);
+
+		try {
+			run(pid, iterations);
+		} catch (...) {
+			kill(pid, SIGKILL);
+			throw;
+		}
+
+		kill(pid, SIGKILL);
+		waitpid(pid, nullptr, 0);
+	} catch (std::system_error const & e) {
+		std::cout << "Error " << e.code().value() << ": " << e.what() << "\n";
+		return 1;
+	}
+}
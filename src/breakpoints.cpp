@@ -0,0 +1,314 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <cerrno>
+#include <map>
+#include <string>
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+}
+
+#include "breakpoints.hpp"
+
+namespace dbpp {
+
+namespace {
+	constexpr std::uint8_t trap_instruction = 0xcc;
+	constexpr std::uintptr_t page_size = 4096;
+
+	/// Debug register with the status of the last debug exception.
+	constexpr int dr6 = 6;
+
+	/// Debug register with the breakpoint control bits.
+	constexpr int dr7 = 7;
+
+	/// Get the DR7 length bits for a breakpoint size.
+	register_t length_bits(std::size_t size) {
+		switch (size) {
+			case 1: return 0;
+			case 2: return 1;
+			case 4: return 3;
+			case 8: return 2;
+		}
+		return 0;
+	}
+
+	/// Execute a single instruction, collecting the signals that arrive before the step completes.
+	/**
+	 * The collected signals are suppressed, so they must be delivered later.
+	 */
+	void step_collecting_signals(int pid, std::vector<int> & signals) {
+		while (true) {
+			step(pid);
+			siginfo_t info;
+			if (waitid(P_PID, pid, &info, WSTOPPED | WEXITED)) throw error(pid, {errno, std::system_category()}, "Tried to wait for a process that doesn't exist");
+			if (info.si_code == CLD_EXITED || info.si_code == CLD_KILLED || info.si_code == CLD_DUMPED) {
+				throw process_terminated(pid, info.si_code == CLD_EXITED, info.si_status, "Process terminated while stepping over a breakpoint");
+			}
+			if (info.si_status == sigtrap) return;
+			signals.push_back(info.si_status);
+		}
+	}
+}
+
+/// Create an empty breakpoint table for a traced process.
+breakpoint_table::breakpoint_table(int pid) : pid_(pid), armed_dr7(0) {
+	for (auto & slot : hardware) slot.used = false;
+	armed_addresses.fill(0);
+
+	std::string path = "/proc/" + std::to_string(pid) + "/mem";
+	memory_fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+	if (memory_fd < 0) throw error(pid, {errno, std::system_category()}, "Failed to open memory of process");
+}
+
+/// Restore the original code of all breakpoints.
+breakpoint_table::~breakpoint_table() {
+	try { apply(true); } catch (...) {}
+	try { apply_hardware(true); } catch (...) {}
+	close(memory_fd);
+}
+
+/// Add a breakpoint or replace the handler of an existing breakpoint.
+void breakpoint_table::insert(std::uintptr_t address, handler_t handler) {
+	auto result = entries.insert({address, entry{0, false, true, std::move(handler), 0}});
+	if (!result.second) {
+		result.first->second.handler = std::move(handler);
+		result.first->second.active  = true;
+	}
+}
+
+/// Add a hardware breakpoint or watchpoint.
+void breakpoint_table::insert_hardware(std::uintptr_t address, watch_condition condition, std::size_t size, handler_t handler) {
+	if (size != 1 && size != 2 && size != 4 && size != 8) throw error(pid_, std::make_error_code(std::errc::invalid_argument), "Hardware breakpoint size must be 1, 2, 4 or 8");
+	if (address % size) throw error(pid_, std::make_error_code(std::errc::invalid_argument), "Hardware breakpoint address must be aligned to its size");
+	if (condition == watch_condition::execute && size != 1) throw error(pid_, std::make_error_code(std::errc::invalid_argument), "Hardware execute breakpoints must have size 1");
+
+	hardware_entry * free = nullptr;
+	for (auto & slot : hardware) {
+		if (slot.used && slot.address == address) {
+			free = &slot;
+			break;
+		}
+		if (!slot.used && !free) free = &slot;
+	}
+	if (!free) throw error(pid_, std::make_error_code(std::errc::device_or_resource_busy), "All hardware breakpoints are in use");
+
+	*free = hardware_entry{true, address, condition, size, std::move(handler), 0};
+}
+
+/// Remove a software or hardware breakpoint.
+void breakpoint_table::erase(std::uintptr_t address) {
+	for (auto & slot : hardware) {
+		if (slot.used && slot.address == address) slot.used = false;
+	}
+
+	auto i = entries.find(address);
+	if (i == entries.end()) return;
+	if (i->second.armed) {
+		i->second.active = false;
+	} else {
+		entries.erase(i);
+	}
+}
+
+/// Write all staged changes to the process.
+void breakpoint_table::arm() {
+	apply(false);
+	apply_hardware(false);
+}
+
+/// Restore the original code of all breakpoints.
+void breakpoint_table::disarm() {
+	apply(true);
+	apply_hardware(true);
+}
+
+/// The number of times a breakpoint has been hit.
+std::uint64_t breakpoint_table::hits(std::uintptr_t address) const {
+	for (auto const & slot : hardware) {
+		if (slot.used && slot.address == address) return slot.hits;
+	}
+	auto i = entries.find(address);
+	if (i == entries.end()) return 0;
+	return i->second.hits;
+}
+
+/// Write the desired state of all breakpoints to memory.
+void breakpoint_table::apply(bool disarm_all) {
+	// Group the breakpoints that need to change by page.
+	std::map<std::uintptr_t, std::vector<std::uintptr_t>> pages;
+	for (auto const & i : entries) {
+		bool want = i.second.active && !disarm_all;
+		if (want != i.second.armed) pages[i.first / page_size].push_back(i.first);
+	}
+
+	std::vector<std::uint8_t> buffer;
+	for (auto & page : pages) {
+		std::vector<std::uintptr_t> & addresses = page.second;
+		std::uintptr_t first = *std::min_element(addresses.begin(), addresses.end());
+		std::uintptr_t last  = *std::max_element(addresses.begin(), addresses.end());
+
+		buffer.resize(last - first + 1);
+		read(first, buffer.data(), buffer.size());
+
+		for (std::uintptr_t address : addresses) {
+			entry & entry = entries[address];
+			std::uint8_t & code = buffer[address - first];
+			if (entry.armed) {
+				code = entry.original;
+			} else {
+				entry.original = code;
+				code = trap_instruction;
+			}
+		}
+
+		write(first, buffer.data(), buffer.size());
+
+		for (std::uintptr_t address : addresses) {
+			auto i = entries.find(address);
+			i->second.armed = !i->second.armed;
+			if (!i->second.active && !i->second.armed) entries.erase(i);
+		}
+	}
+}
+
+/// Write the desired hardware breakpoints to the debug registers.
+void breakpoint_table::apply_hardware(bool disarm_all) {
+	register_t wanted = 0;
+	if (!disarm_all) {
+		for (int i = 0; i < hardware_breakpoint_slots; ++i) {
+			hardware_entry const & slot = hardware[i];
+			if (!slot.used) continue;
+			wanted |= register_t(1) << (2 * i);
+			wanted |= register_t(slot.condition) << (16 + 4 * i);
+			wanted |= length_bits(slot.size) << (18 + 4 * i);
+		}
+	}
+
+	bool addresses_changed = false;
+	for (int i = 0; i < hardware_breakpoint_slots; ++i) {
+		if ((wanted & (register_t(1) << (2 * i))) && armed_addresses[i] != hardware[i].address) addresses_changed = true;
+	}
+	if (wanted == armed_dr7 && !addresses_changed) return;
+
+	// The kernel validates the addresses when DR7 enables them,
+	// so disable all slots before changing addresses and write DR7 last.
+	if (armed_dr7) write_debug_register(pid_, dr7, 0);
+	armed_dr7 = 0;
+	for (int i = 0; i < hardware_breakpoint_slots; ++i) {
+		if (!(wanted & (register_t(1) << (2 * i)))) continue;
+		write_debug_register(pid_, i, hardware[i].address);
+		armed_addresses[i] = hardware[i].address;
+	}
+	if (wanted) write_debug_register(pid_, dr7, wanted);
+	armed_dr7 = wanted;
+}
+
+/// Handle a trap caused by a hardware breakpoint.
+bool breakpoint_table::dispatch_hardware(registers_t & registers) {
+	register_t status = read_debug_register(pid_, dr6);
+	if (!(status & 0xf)) return false;
+	write_debug_register(pid_, dr6, 0);
+
+	for (int i = 0; i < hardware_breakpoint_slots; ++i) {
+		hardware_entry & slot = hardware[i];
+		if (!(status & (register_t(1) << i)) || !(armed_dr7 & (register_t(1) << (2 * i)))) continue;
+
+		// Copy the handler, since it may modify the table.
+		++slot.hits;
+		handler_t handler = slot.handler;
+		if (handler) handler(pid_, registers);
+	}
+
+	// The kernel sets the resume flag for execute breakpoints, so the process doesn't trap again on the same instruction.
+	set_registers(pid_, registers);
+	return true;
+}
+
+/// Handle a trap of the stopped process.
+bool breakpoint_table::dispatch() {
+	registers_t registers = get_registers(pid_);
+	if (armed_dr7 && dispatch_hardware(registers)) return true;
+
+	std::uintptr_t address = registers.ip - 1;
+
+	auto i = entries.find(address);
+	if (i == entries.end() || !i->second.armed) return false;
+
+	// Copy the original code, since the handler may modify the table.
+	std::uint8_t original = i->second.original;
+	++i->second.hits;
+	registers.ip = address;
+	if (i->second.handler) i->second.handler(pid_, registers);
+	set_registers(pid_, registers);
+
+	// Execute the original instruction and re-insert the trap, unless the handler redirected the process.
+	if (registers.ip == address) {
+		auto rearm = [&] () {
+			auto j = entries.find(address);
+			if (j != entries.end() && j->second.armed) {
+				if (j->second.active) {
+					write(address, &trap_instruction, 1);
+				} else {
+					entries.erase(j);
+				}
+			}
+		};
+
+		write(address, &original, 1);
+		try {
+			step_collecting_signals(pid_, pending_signals);
+		} catch (...) {
+			// Never leave an armed breakpoint without its trap.
+			try { rearm(); } catch (...) {}
+			throw;
+		}
+		rearm();
+	}
+
+	return true;
+}
+
+/// Take a signal that arrived while stepping over a breakpoint.
+int breakpoint_table::take_signal() {
+	if (pending_signals.empty()) return 0;
+	int signal = pending_signals.front();
+	pending_signals.erase(pending_signals.begin());
+	return signal;
+}
+
+/// Read a block of memory through /proc/<pid>/mem.
+void breakpoint_table::read(std::uintptr_t address, void * data, std::size_t length) {
+	ssize_t result = pread(memory_fd, data, length, address);
+	if (result < 0) throw error(pid_, {errno, std::system_category()}, "Failed to read memory from process");
+	if (std::size_t(result) != length) throw error(pid_, std::make_error_code(std::errc::bad_address), "Failed to read memory from process");
+}
+
+/// Write a block of memory through /proc/<pid>/mem.
+void breakpoint_table::write(std::uintptr_t address, void const * data, std::size_t length) {
+	ssize_t result = pwrite(memory_fd, data, length, address);
+	if (result < 0) throw error(pid_, {errno, std::system_category()}, "Failed to write to process memory");
+	if (std::size_t(result) != length) throw error(pid_, std::make_error_code(std::errc::bad_address), "Failed to write to process memory");
+}
+
+}
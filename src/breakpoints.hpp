@@ -0,0 +1,189 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "dbpp.hpp"
+
+namespace dbpp {
+
+/// A table of software breakpoints in a single traced process.
+/**
+ * Unlike breakpoint, breakpoints in the table stay active after they are hit:
+ * dispatch() runs the handler, steps over the original instruction and re-inserts the trap.
+ *
+ * Changes made by insert() and erase() are staged and written by arm(),
+ * which writes all changes to the same page with a single write to /proc/<pid>/mem.
+ *
+ * Up to four hardware breakpoints and watchpoints can be added with insert_hardware().
+ * They use the debug registers instead of modifying code, and are dispatched the same way.
+ */
+class breakpoint_table {
+public:
+	/// Function called when a breakpoint is hit.
+	/**
+	 * The registers have the instruction pointer set to the breakpoint address.
+	 * Changes to the registers are written back to the process.
+	 * If the handler changes the instruction pointer, the original instruction is not executed.
+	 */
+	using handler_t = std::function<void (int pid, registers_t & registers)>;
+
+	/// Create an empty breakpoint table for a traced process.
+	/**
+	 * Throws on failure.
+	 */
+	explicit breakpoint_table(int pid);
+
+	breakpoint_table(breakpoint_table const &) = delete;
+	breakpoint_table & operator= (breakpoint_table const &) = delete;
+
+	/// Restore the original code of all breakpoints.
+	/**
+	 * Errors are silently ignored.
+	 */
+	~breakpoint_table();
+
+	/// The process in which the breakpoints are set.
+	int pid() const { return pid_; }
+
+	/// The number of breakpoints in the table.
+	std::size_t size() const { return entries.size(); }
+
+	/// Add a breakpoint or replace the handler of an existing breakpoint.
+	/**
+	 * The breakpoint becomes active on the next call to arm().
+	 */
+	void insert(std::uintptr_t address, handler_t handler);
+
+	/// Add a hardware breakpoint or watchpoint.
+	/**
+	 * The breakpoint becomes active on the next call to arm().
+	 * Size must be 1, 2, 4 or 8 and the address must be aligned to the size.
+	 * Execute breakpoints must have size 1.
+	 *
+	 * For write and read_write watchpoints, the handler is called after the accessing instruction has executed.
+	 *
+	 * Throws if all debug registers are in use or if the size or alignment is invalid.
+	 */
+	void insert_hardware(std::uintptr_t address, watch_condition condition, std::size_t size, handler_t handler);
+
+	/// Remove a software or hardware breakpoint.
+	/**
+	 * The original code or debug registers are restored on the next call to arm().
+	 */
+	void erase(std::uintptr_t address);
+
+	/// Write all staged changes to the process.
+	/**
+	 * Throws on failure.
+	 */
+	void arm();
+
+	/// Restore the original code of all breakpoints, without removing them from the table.
+	/**
+	 * Call arm() to activate them again.
+	 * Throws on failure.
+	 */
+	void disarm();
+
+	/// The number of times a breakpoint has been hit.
+	std::uint64_t hits(std::uintptr_t address) const;
+
+	/// Handle a trap of the stopped process.
+	/**
+	 * If the process trapped on one of the breakpoints, the handler is called,
+	 * the original instruction is executed with a single step and the breakpoint is re-inserted.
+	 * The process is stopped again when this function returns.
+	 *
+	 * Signals that arrive during the single step are held back and can be taken with take_signal().
+	 *
+	 * \return True if the trap was caused by a breakpoint in the table, false otherwise.
+	 * Throws on failure.
+	 */
+	bool dispatch();
+
+	/// Take a signal that arrived while stepping over a breakpoint, or 0 if there is none.
+	/**
+	 * Pass the signal to the next resume() of the process, so it is delivered after all.
+	 * If several signals arrived, each call returns the next one.
+	 */
+	int take_signal();
+
+private:
+	struct entry {
+		/// The original byte of code at the breakpoint address.
+		std::uint8_t original;
+
+		/// True if the trap instruction is currently written to the process.
+		bool armed;
+
+		/// True if the breakpoint should be armed.
+		bool active;
+
+		handler_t handler;
+		std::uint64_t hits;
+	};
+
+	struct hardware_entry {
+		bool used;
+		std::uintptr_t address;
+		watch_condition condition;
+		std::size_t size;
+		handler_t handler;
+		std::uint64_t hits;
+	};
+
+	int pid_;
+	int memory_fd;
+	std::unordered_map<std::uintptr_t, entry> entries;
+
+	std::array<hardware_entry, hardware_breakpoint_slots> hardware;
+
+	/// The value of DR7 currently written to the process.
+	register_t armed_dr7;
+
+	/// The addresses currently written to DR0 to DR3.
+	std::array<std::uintptr_t, hardware_breakpoint_slots> armed_addresses;
+
+	/// Signals that arrived while stepping over a breakpoint, in order of arrival.
+	std::vector<int> pending_signals;
+
+	/// Write the desired hardware breakpoints to the debug registers.
+	void apply_hardware(bool disarm_all);
+
+	/// Handle a trap caused by a hardware breakpoint.
+	bool dispatch_hardware(registers_t & registers);
+
+	/// Write the desired state of all breakpoints to memory.
+	void apply(bool disarm_all);
+
+	/// Read a block of memory through /proc/<pid>/mem.
+	void read(std::uintptr_t address, void * data, std::size_t length);
+
+	/// Write a block of memory through /proc/<pid>/mem.
+	void write(std::uintptr_t address, void const * data, std::size_t length);
+};
+
+}
@@ -0,0 +1,128 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cerrno>
+#include <exception>
+#include <new>
+#include <string>
+
+#include "fdinject.h"
+#include "inject.hpp"
+
+struct fdinject_session {
+	fdinject::session session;
+
+	explicit fdinject_session(int pid, fdinject::session_options const & options = fdinject::session_options()) : session(pid, options) {}
+};
+
+namespace {
+	thread_local int last_errno = 0;
+	thread_local std::string last_error;
+
+	fdinject_status fail(fdinject_status status, int error, char const * what) {
+		last_errno = error;
+		last_error = what;
+		return status;
+	}
+
+	/// Run a function and translate any exception to a status code.
+	template<typename F>
+	fdinject_status translate(F && f) {
+		last_errno = 0;
+		last_error.clear();
+		try {
+			f();
+			return FDINJECT_OK;
+		} catch (dbpp::process_terminated const & e) {
+			return fail(FDINJECT_ERROR_TERMINATED, e.code().value(), e.what());
+		} catch (dbpp::unexpected_signal const & e) {
+			return fail(FDINJECT_ERROR_SIGNAL, e.code().value(), e.what());
+		} catch (std::system_error const & e) {
+			return fail(FDINJECT_ERROR_SYSTEM, e.code().value(), e.what());
+		} catch (std::bad_alloc const & e) {
+			return fail(FDINJECT_ERROR_NO_MEMORY, ENOMEM, e.what());
+		} catch (std::exception const & e) {
+			return fail(FDINJECT_ERROR_UNKNOWN, 0, e.what());
+		} catch (...) {
+			return fail(FDINJECT_ERROR_UNKNOWN, 0, "unknown error");
+		}
+	}
+}
+
+extern "C" {
+
+fdinject_status fdinject_attach(int pid, fdinject_session ** session) {
+	if (!session) return fail(FDINJECT_ERROR_INVALID, EINVAL, "session may not be null");
+	return translate([&] () {
+		*session = new fdinject_session(pid);
+	});
+}
+
+fdinject_status fdinject_attach_cached(int pid, size_t cache_budget, fdinject_session ** session) {
+	if (!session) return fail(FDINJECT_ERROR_INVALID, EINVAL, "session may not be null");
+	fdinject::session_options options;
+	options.cache_budget = cache_budget;
+	return translate([&] () {
+		*session = new fdinject_session(pid, options);
+	});
+}
+
+fdinject_status fdinject_inject(fdinject_session * session, int fd, void const * data, size_t length) {
+	if (!session) return fail(FDINJECT_ERROR_INVALID, EINVAL, "session may not be null");
+	if (!data && length) return fail(FDINJECT_ERROR_INVALID, EINVAL, "data may not be null");
+	return translate([&] () {
+		session->session.inject(fd, data, length);
+	});
+}
+
+fdinject_status fdinject_detach(fdinject_session * session) {
+	if (!session) return fail(FDINJECT_ERROR_INVALID, EINVAL, "session may not be null");
+	fdinject_status result = translate([&] () {
+		session->session.detach();
+	});
+	delete session;
+	return result;
+}
+
+int fdinject_pid(fdinject_session const * session) {
+	if (!session) return -1;
+	return session->session.pid();
+}
+
+fdinject_status fdinject_get_cache_stats(fdinject_session const * session, fdinject_cache_stats * stats) {
+	if (!session) return fail(FDINJECT_ERROR_INVALID, EINVAL, "session may not be null");
+	if (!stats)   return fail(FDINJECT_ERROR_INVALID, EINVAL, "stats may not be null");
+	fdinject::cache_stats const & cache = session->session.cache_statistics();
+	stats->hits      = cache.hits;
+	stats->misses    = cache.misses;
+	stats->evictions = cache.evictions;
+	stats->entries   = cache.entries;
+	stats->resident  = cache.resident;
+	return FDINJECT_OK;
+}
+
+int fdinject_last_errno(void) {
+	return last_errno;
+}
+
+char const * fdinject_last_error(void) {
+	return last_error.c_str();
+}
+
+}
@@ -0,0 +1,82 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cstring>
+#include <iterator>
+#include <utility>
+
+#include "cache.hpp"
+#include "hash.hpp"
+
+namespace fdinject {
+
+payload_cache::entry const * payload_cache::find(void const * data, std::size_t length) {
+	auto found = index.find(hash64(data, length));
+	if (found == index.end() || found->second->data.size() != length || std::memcmp(found->second->data.data(), data, length) != 0) {
+		++stats_.misses;
+		return nullptr;
+	}
+
+	++stats_.hits;
+	entries.splice(entries.begin(), entries, found->second);
+	return &entries.front();
+}
+
+std::vector<payload_cache::entry> payload_cache::insert(void const * data, std::size_t length, std::uintptr_t address, std::size_t size) {
+	std::vector<entry> removed;
+	std::uint64_t key = hash64(data, length);
+
+	auto existing = index.find(key);
+	if (existing != index.end()) remove(existing->second, removed);
+
+	while (!entries.empty() && stats_.resident + size > budget_) {
+		remove(std::prev(entries.end()), removed);
+		++stats_.evictions;
+	}
+
+	std::uint8_t const * bytes = static_cast<std::uint8_t const *>(data);
+	entries.push_front(entry{key, std::vector<std::uint8_t>(bytes, bytes + length), address, size});
+	index[key] = entries.begin();
+	++stats_.entries;
+	stats_.resident += size;
+	return removed;
+}
+
+bool payload_cache::missed_before(void const * data, std::size_t length) {
+	// Forget everything rather than tracking the age of each key, a repeating payload is remembered again soon enough.
+	constexpr std::size_t max_missed = 4096;
+	if (missed.size() >= max_missed) missed.clear();
+	return !missed.insert(hash64(data, length)).second;
+}
+
+std::vector<payload_cache::entry> payload_cache::clear() {
+	std::vector<entry> removed;
+	while (!entries.empty()) remove(entries.begin(), removed);
+	return removed;
+}
+
+void payload_cache::remove(std::list<entry>::iterator entry, std::vector<payload_cache::entry> & removed) {
+	index.erase(entry->key);
+	--stats_.entries;
+	stats_.resident -= entry->size;
+	removed.push_back(std::move(*entry));
+	entries.erase(entry);
+}
+
+}
@@ -0,0 +1,126 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace fdinject {
+
+/// Statistics of a payload cache.
+struct cache_stats {
+	/// The number of lookups that found the payload.
+	std::uint64_t hits = 0;
+
+	/// The number of lookups that didn't find the payload.
+	std::uint64_t misses = 0;
+
+	/// The number of payloads evicted to stay within the budget.
+	std::uint64_t evictions = 0;
+
+	/// The number of payloads currently cached.
+	std::size_t entries = 0;
+
+	/// The size of the remote memory currently used by cached payloads.
+	std::size_t resident = 0;
+};
+
+/// Bookkeeping for payloads that are kept in memory of a target, keyed by the hash of their contents.
+/**
+ * The cache only tracks remote memory, the caller allocates and frees it.
+ * Payloads are evicted in least recently used order when the total size of their remote memory exceeds the budget.
+ * A local copy of each payload is kept to rule out hash collisions.
+ */
+class payload_cache {
+public:
+	/// A cached payload.
+	struct entry {
+		/// The hash of the payload.
+		std::uint64_t key;
+
+		/// The contents of the payload.
+		std::vector<std::uint8_t> data;
+
+		/// The address of the remote memory holding the payload.
+		std::uintptr_t address;
+
+		/// The size of the remote memory, which may be larger than the payload.
+		std::size_t size;
+	};
+
+	explicit payload_cache(std::size_t budget) : budget_(budget) {}
+
+	/// The maximum size of the remote memory used by cached payloads.
+	std::size_t budget() const { return budget_; }
+
+	/// Check if a payload with a given remote memory size can be cached at all.
+	bool fits(std::size_t size) const { return size <= budget_; }
+
+	/// Look up a payload and mark it as most recently used.
+	/**
+	 * \return The cached entry, or null if the payload is not cached.
+	 */
+	entry const * find(void const * data, std::size_t length);
+
+	/// Add a payload that was just copied to remote memory.
+	/**
+	 * If a different payload with the same hash is cached, it is replaced.
+	 * \return The entries that were evicted or replaced, whose remote memory must be freed by the caller.
+	 */
+	std::vector<entry> insert(void const * data, std::size_t length, std::uintptr_t address, std::size_t size);
+
+	/// Remember a payload that is not cached and check if it was remembered before.
+	/**
+	 * This is used to cache payloads only once they repeat.
+	 * Only a limited number of payloads is remembered.
+	 */
+	bool missed_before(void const * data, std::size_t length);
+
+	/// Remove all entries.
+	/**
+	 * \return The removed entries, whose remote memory must be freed by the caller.
+	 */
+	std::vector<entry> clear();
+
+	/// Get the statistics of the cache.
+	cache_stats const & stats() const { return stats_; }
+
+private:
+	std::size_t budget_;
+	cache_stats stats_;
+
+	/// The entries, most recently used first.
+	std::list<entry> entries;
+
+	/// The entries by key.
+	std::unordered_map<std::uint64_t, std::list<entry>::iterator> index;
+
+	/// The keys of payloads remembered by missed_before().
+	std::unordered_set<std::uint64_t> missed;
+
+	/// Remove an entry and add it to a list of removed entries.
+	void remove(std::list<entry>::iterator entry, std::vector<payload_cache::entry> & removed);
+};
+
+}
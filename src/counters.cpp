@@ -0,0 +1,94 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cerrno>
+#include <cstring>
+
+extern "C" {
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+}
+
+#include "counters.hpp"
+#include "dbpp.hpp"
+
+namespace fdinject {
+
+namespace {
+	/// The counted events, in the order of impact_counters::fds.
+	constexpr std::uint64_t events[] = {
+		PERF_COUNT_SW_TASK_CLOCK,
+		PERF_COUNT_SW_CONTEXT_SWITCHES,
+		PERF_COUNT_SW_PAGE_FAULTS,
+		PERF_COUNT_SW_PAGE_FAULTS_MIN,
+	};
+
+	int open_counter(int tid, std::uint64_t event) {
+		perf_event_attr attributes;
+		std::memset(&attributes, 0, sizeof(attributes));
+		attributes.type   = PERF_TYPE_SOFTWARE;
+		attributes.size   = sizeof(attributes);
+		attributes.config = event;
+		// Work done in the kernel on behalf of injected system calls is exactly what we want to see.
+		attributes.exclude_hv = 1;
+
+		int fd = ::syscall(SYS_perf_event_open, &attributes, tid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+		if (fd < 0) throw dbpp::error(tid, {errno, std::system_category()}, "Failed to open performance counter");
+		return fd;
+	}
+}
+
+std::ostream & operator<< (std::ostream & stream, impact const & impact) {
+	return stream
+		<< "task-clock " << impact.task_clock / 1e6 << " ms, "
+		<< "context-switches " << impact.context_switches << ", "
+		<< "page-faults " << impact.page_faults << ", "
+		<< "minor-faults " << impact.minor_faults;
+}
+
+impact_counters::impact_counters(int tid) : tid(tid) {
+	fds.fill(-1);
+	try {
+		for (std::size_t i = 0; i < fds.size(); ++i) fds[i] = open_counter(tid, events[i]);
+	} catch (...) {
+		for (int fd : fds) if (fd >= 0) close(fd);
+		throw;
+	}
+}
+
+impact_counters::~impact_counters() {
+	for (int fd : fds) close(fd);
+}
+
+impact impact_counters::read() const {
+	std::uint64_t values[4];
+	for (std::size_t i = 0; i < fds.size(); ++i) {
+		if (::read(fds[i], &values[i], sizeof(values[i])) != sizeof(values[i])) throw dbpp::error(tid, {errno, std::system_category()}, "Failed to read performance counter");
+	}
+
+	impact result;
+	result.task_clock       = values[0];
+	result.context_switches = values[1];
+	result.page_faults      = values[2];
+	result.minor_faults     = values[3];
+	return result;
+}
+
+}
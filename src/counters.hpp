@@ -0,0 +1,76 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+
+namespace fdinject {
+
+/// Software event counts of a thread.
+struct impact {
+	/// CPU time in nanoseconds.
+	std::uint64_t task_clock = 0;
+
+	/// Number of context switches.
+	std::uint64_t context_switches = 0;
+
+	/// Number of page faults.
+	std::uint64_t page_faults = 0;
+
+	/// Number of minor page faults, which didn't need I/O.
+	std::uint64_t minor_faults = 0;
+};
+
+/// Print the counts of an impact on one line.
+std::ostream & operator<< (std::ostream & stream, impact const & impact);
+
+/// Software performance counters that measure the impact of tracing on a thread.
+/**
+ * The counters are opened with perf_event_open and count from the moment they are created,
+ * including everything the thread does by itself in that time.
+ */
+class impact_counters {
+public:
+	/// Start counting for a thread.
+	/**
+	 * Throws on failure, for example if perf events are restricted by kernel.perf_event_paranoid.
+	 */
+	explicit impact_counters(int tid);
+
+	impact_counters(impact_counters const &) = delete;
+	impact_counters & operator= (impact_counters const &) = delete;
+
+	/// Close the counters.
+	~impact_counters();
+
+	/// Read the counts since the counters were started.
+	/**
+	 * Throws on failure.
+	 */
+	impact read() const;
+
+private:
+	int tid;
+	std::array<int, 4> fds;
+};
+
+}
@@ -20,11 +20,16 @@ extern "C" {
 #include <signal.h>
 #include <sys/ptrace.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/user.h>
 #include <sys/wait.h>
 #include <unistd.h>
 }
 
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+
 #include "dbpp.hpp"
 
 namespace dbpp {
@@ -205,7 +210,12 @@ void trace_me() {
 
 /// Attach to a process.
 void attach(int pid) {
-	if (ptrace(PTRACE_SEIZE, pid, nullptr, PTRACE_O_TRACESYSGOOD)) throw error(pid, {errno, std::system_category()}, "Failed to attach to process");
+	attach(pid, PTRACE_O_TRACESYSGOOD);
+}
+
+/// Attach to a process with a set of ptrace options.
+void attach(int pid, int options) {
+	if (ptrace(PTRACE_SEIZE, pid, nullptr, options)) throw error(pid, {errno, std::system_category()}, "Failed to attach to process");
 }
 
 /// Detach from a process.
@@ -219,8 +229,18 @@ void interrupt(int pid) {
 }
 
 /// Resume a stopped process.
-void resume(int pid) {
-	if (ptrace(PTRACE_CONT, pid, nullptr, nullptr)) throw error(pid, {errno, std::system_category()}, "Failed to continue process");
+void resume(int pid, int signal) {
+	if (ptrace(PTRACE_CONT, pid, nullptr, signal)) throw error(pid, {errno, std::system_category()}, "Failed to continue process");
+}
+
+/// Let a traced process in a group-stop wait for SIGCONT without resuming it.
+void listen(int pid) {
+	if (ptrace(PTRACE_LISTEN, pid, nullptr, nullptr)) throw error(pid, {errno, std::system_category()}, "Failed to listen to process");
+}
+
+/// Set the ptrace options of a traced process.
+void set_options(int pid, int options) {
+	if (ptrace(PTRACE_SETOPTIONS, pid, nullptr, options)) throw error(pid, {errno, std::system_category()}, "Failed to set ptrace options");
 }
 
 /// Have a stopped process execute one instruction.
@@ -296,6 +316,43 @@ void memcpy_from(int pid, void * destination, std::uintptr_t source, std::size_t
 	}
 }
 
+/// Copy a block of memory from a process with process_vm_readv.
+std::size_t read_memory_bulk(int pid, void * destination, std::uintptr_t source, std::size_t count) {
+	iovec local  = {destination, count};
+	iovec remote = {reinterpret_cast<void *>(source), count};
+
+	std::size_t total = 0;
+	while (total < count) {
+		ssize_t result = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+		if (result < 0 && errno == EFAULT) break;
+		if (result < 0) throw error(pid, {errno, std::system_category()}, "Failed to read memory from process");
+		if (result == 0) break;
+
+		total += result;
+		local.iov_base  = static_cast<std::uint8_t *>(local.iov_base) + result;
+		local.iov_len  -= result;
+		remote.iov_base = static_cast<std::uint8_t *>(remote.iov_base) + result;
+		remote.iov_len -= result;
+	}
+
+	return total;
+}
+
+/// Read a debug register of a process.
+register_t read_debug_register(int pid, int index) {
+	errno = 0;
+	register_t result = ptrace(PTRACE_PEEKUSER, pid, offsetof(struct user, u_debugreg) + index * sizeof(register_t), nullptr);
+	if (errno) throw error(pid, {errno, std::system_category()}, "Failed to read debug register");
+	return result;
+}
+
+/// Write a debug register of a process.
+void write_debug_register(int pid, int index, register_t value) {
+	if (ptrace(PTRACE_POKEUSER, pid, offsetof(struct user, u_debugreg) + index * sizeof(register_t), value) != 0) {
+		throw error(pid, {errno, std::system_category()}, "Failed to write debug register");
+	}
+}
+
 /// Set return address of the current function and return the old address.
 std::uintptr_t swap_return_address(int pid, std::uintptr_t address) {
 	auto registers = get_registers(pid);
@@ -326,11 +383,49 @@ void breakpoint::restore() {
 	set_registers(pid, regs);
 }
 
+
+namespace {
+	/// Interval of the first and the last poll while waiting with a deadline.
+	/**
+	 * The interval doubles after every poll, so fast traps are noticed quickly
+	 * while slow ones do not keep the tracer busy.
+	 */
+	constexpr std::chrono::microseconds min_poll_interval{10};
+	constexpr std::chrono::microseconds max_poll_interval{1000};
+
+	/// Wait for a state change of a traced process, giving up at a deadline.
+	/**
+	 * Without deadline this is a blocking waitid().
+	 * Otherwise waitid() is polled with WNOHANG.
+	 * SIGCHLD is not used to wake up, because it is delivered to the whole process
+	 * and consuming it would take it away from the application.
+	 * A pidfd can't be used for this, because it only becomes readable when the process exits, not when it stops.
+	 */
+	void wait_for_change(int pid, siginfo_t & info, deadline_t deadline) {
+		if (deadline == deadline_t::max()) {
+			if (waitid(P_PID, pid, &info, WSTOPPED | WEXITED)) throw error(pid, {errno, std::system_category()}, "Tried to wait for a process that doesn't exist");
+			return;
+		}
+
+		std::chrono::microseconds interval = min_poll_interval;
+		while (true) {
+			info.si_pid = 0;
+			if (waitid(P_PID, pid, &info, WSTOPPED | WEXITED | WNOHANG)) throw error(pid, {errno, std::system_category()}, "Tried to wait for a process that doesn't exist");
+			if (info.si_pid) return;
+
+			auto now = std::chrono::steady_clock::now();
+			if (now >= deadline) throw deadline_exceeded(pid, "Process did not trap before the deadline");
+			std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(deadline - now, interval));
+			interval = std::min(interval * 2, max_poll_interval);
+		}
+	}
+}
+
 /// Wait for a traced process to trap.
-void wait_for_trap(int pid) {
+void wait_for_trap(int pid, deadline_t deadline) {
 	while (true) {
 		siginfo_t info;
-		if (waitid(P_PID, pid, &info, WSTOPPED | WEXITED)) throw error(pid, {errno, std::system_category()}, "Tried to wait for a process that doesn't exist");
+		wait_for_change(pid, info, deadline);
 
 		switch (info.si_code) {
 		case CLD_EXITED:
@@ -350,9 +445,9 @@ void wait_for_trap(int pid) {
 }
 
 /// Wait for a traced process to trap at a specific address.
-void wait_for_trap(int pid, std::uintptr_t address) {
+void wait_for_trap(int pid, std::uintptr_t address, deadline_t deadline) {
 	while (true) {
-		wait_for_trap(pid);
+		wait_for_trap(pid, deadline);
 		registers_t regs = get_registers(pid);
 		if (regs.ip - 1 == address) {
 			return;
@@ -367,10 +462,10 @@ void * get_trap() {
 }
 
 /// Wait for a traced process to trap at entry to or exit from a system call.
-bool wait_for_syscall(int pid) {
+bool wait_for_syscall(int pid, deadline_t deadline) {
 	while (true) {
 		siginfo_t info;
-		if (waitid(P_PID, pid, &info, WSTOPPED | WEXITED) != 0) throw error(pid, {errno, std::system_category()}, "Tried to wait for a process that doesn't exist");
+		wait_for_change(pid, info, deadline);
 
 		switch (info.si_code) {
 		case CLD_EXITED:
@@ -18,6 +18,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <cstdint>
 #include <utility>
 
@@ -35,6 +36,15 @@ static_assert(false,
 
 using register_t = std::uintptr_t;
 
+/// The point in time at which a wait for a process gives up.
+/**
+ * The default deadline, deadline_t::max(), never passes.
+ *
+ * Waiting with a deadline polls the state of the process, so it does not depend on or consume SIGCHLD.
+ * Signal handlers and signal masks of the application are left alone.
+ */
+using deadline_t = std::chrono::steady_clock::time_point;
+
 /// Class to hold all general purpose registers.
 struct registers_t {
 	register_t ax;
@@ -94,6 +104,16 @@ struct breakpoint {
 	void restore();
 };
 
+/// The condition that triggers a hardware breakpoint.
+enum class watch_condition {
+	execute    = 0, ///< Trap before an instruction at the address is executed.
+	write      = 1, ///< Trap after data at the address is written.
+	read_write = 3, ///< Trap after data at the address is read or written.
+};
+
+/// The number of hardware breakpoint slots (debug registers DR0 to DR3).
+constexpr int hardware_breakpoint_slots = 4;
+
 /// Struct to hold the result of calling call_sandboxed.
 struct call_result {
 	int pid;
@@ -137,6 +157,14 @@ void trace_me();
  */
 void attach(int pid);
 
+/// Attach to a process with a set of ptrace options.
+/**
+ * The process keeps running.
+ *
+ * Throws on failure.
+ */
+void attach(int pid, int options);
+
 /// Detach from a process.
 /**
  * Throws on failure.
@@ -147,10 +175,26 @@ void detach(int pid);
 void interrupt(int pid);
 
 /// Resume a trapped child.
+/**
+ * If signal is not 0, the signal is delivered to the child.
+ *
+ * Throws on failure.
+ */
+void resume(int pid, int signal = 0);
+
+/// Let a traced process in a group-stop wait for SIGCONT without resuming it.
+/**
+ * Unlike resume(), this keeps job control stops working while the tracer still receives events.
+ *
+ * Throws on failure.
+ */
+void listen(int pid);
+
+/// Set the ptrace options of a traced process.
 /**
  * Throws on failure.
  */
-void resume(int pid);
+void set_options(int pid, int options);
 
 /// Have a traced process execute one instruction.
 /**
@@ -200,6 +244,30 @@ void memcpy_to(int pid, std::uintptr_t destination, void const * source, std::si
  */
 void memcpy_from(int pid, void * destination, std::uintptr_t source, std::size_t count);
 
+/// Copy a block of memory from a process with process_vm_readv.
+/**
+ * Unlike memcpy_from, this copies the whole block with a single system call.
+ * The process does not need to be stopped or traced, but the caller needs permission to trace it.
+ *
+ * Copying stops at the first page that can not be read.
+ * \return The number of bytes copied, which is 0 if the first page can not be read.
+ *
+ * Throws on failure.
+ */
+std::size_t read_memory_bulk(int pid, void * destination, std::uintptr_t source, std::size_t count);
+
+/// Read a debug register of a process.
+/**
+ * Throws on failure.
+ */
+register_t read_debug_register(int pid, int index);
+
+/// Write a debug register of a process.
+/**
+ * Throws on failure.
+ */
+void write_debug_register(int pid, int index, register_t value);
+
 /// Set return address of the current function and return the old address.
 /**
  * Must be called before anything has been done to the stack by the function.
@@ -212,21 +280,24 @@ std::uintptr_t swap_return_address(int pid, std::uintptr_t address);
 /// Wait for a traced child to trap.
 /**
  * Throws if the child is already dead or if it terminates before it traps.
+ * Throws deadline_exceeded if the child did not trap before the deadline.
  */
-void wait_for_trap(int pid);
+void wait_for_trap(int pid, deadline_t deadline = deadline_t::max());
 
 /// Wait for a traced child to trap at a specific address.
 /**
  * Throws if the child is already dead or if it terminates before it traps.
+ * Throws deadline_exceeded if the child did not trap at the address before the deadline.
  */
-void wait_for_trap(int pid, std::uintptr_t address);
+void wait_for_trap(int pid, std::uintptr_t address, deadline_t deadline = deadline_t::max());
 
 /// Wait for a traced child to trap.
 /**
  * \return True if the process trapped on entry to or exit from a system call, false if it trapped for another reason.
  * Throws if the child is already dead or if it terminates before it traps.
+ * Throws deadline_exceeded if the child did not trap before the deadline.
  */
-bool wait_for_syscall(int pid);
+bool wait_for_syscall(int pid, deadline_t deadline = deadline_t::max());
 
 /// Get the address of a trap instruction in this process' memory.
 void * get_trap();
@@ -245,7 +316,7 @@ bool call_sandboxed(call_result & result, R (*f) (A...), B && ...args) {
 		// Parent should have set a breakpoint now, so execute the function.
 		f(std::forward<B>(args)...);
 
-		// TODO: Copy result to parent, somehow.
+		// The result is not copied to the parent. Use sandbox_server from sandbox.hpp to get results back.
 
 		// Parent should kill us before we reach this.
 		exit(0);
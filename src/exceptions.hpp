@@ -74,4 +74,17 @@ public:
 		signal(signal) {}
 };
 
+/// Thrown when a process did not show the expected behaviour before a deadline.
+class deadline_exceeded : public error {
+public:
+	deadline_exceeded(int pid) :
+		error(pid, std::make_error_code(std::errc::timed_out)) {}
+
+	deadline_exceeded(int pid, std::string const & what) :
+		error(pid, std::make_error_code(std::errc::timed_out), what) {}
+
+	deadline_exceeded(int pid, char const * what) :
+		error(pid, std::make_error_code(std::errc::timed_out), what) {}
+};
+
 }
@@ -0,0 +1,225 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+extern "C" {
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+}
+
+#include "extract.hpp"
+#include "fdinfo.hpp"
+#include "inject.hpp"
+
+namespace fdinject {
+
+namespace {
+	/// Two local buffers handed back and forth between the reader and the sink thread.
+	class double_buffer {
+	public:
+		explicit double_buffer(std::size_t size) {
+			for (auto & slot : slots) slot.data.reset(new std::uint8_t[size]);
+		}
+
+		/// Wait for a free buffer to fill.
+		/**
+		 * \return Null if the consumer failed.
+		 */
+		std::uint8_t * acquire() {
+			std::unique_lock<std::mutex> lock(mutex);
+			changed.wait(lock, [&] () { return !slots[produce].full || error; });
+			if (error) return nullptr;
+			return slots[produce].data.get();
+		}
+
+		/// Hand a filled buffer to the consumer.
+		void publish(std::size_t size) {
+			std::lock_guard<std::mutex> lock(mutex);
+			slots[produce].size = size;
+			slots[produce].full = true;
+			produce ^= 1;
+			changed.notify_all();
+		}
+
+		/// Tell the consumer no more buffers will follow.
+		void finish() {
+			std::lock_guard<std::mutex> lock(mutex);
+			finished = true;
+			changed.notify_all();
+		}
+
+		/// Pass all buffers to the sink until finish() is called.
+		void consume(extract_sink const & sink) {
+			while (true) {
+				std::unique_lock<std::mutex> lock(mutex);
+				changed.wait(lock, [&] () { return slots[consume_index].full || finished; });
+				if (!slots[consume_index].full) return;
+				slot & slot = slots[consume_index];
+				lock.unlock();
+
+				try {
+					sink(slot.data.get(), slot.size);
+				} catch (...) {
+					lock.lock();
+					error = std::current_exception();
+					changed.notify_all();
+					return;
+				}
+
+				lock.lock();
+				slot.full = false;
+				consume_index ^= 1;
+				changed.notify_all();
+			}
+		}
+
+		/// Rethrow the exception of the consumer, if any.
+		void check() {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (error) std::rethrow_exception(error);
+		}
+
+	private:
+		struct slot {
+			std::unique_ptr<std::uint8_t[]> data;
+			std::size_t size = 0;
+			bool full = false;
+		};
+
+		slot slots[2];
+		int produce       = 0;
+		int consume_index = 0;
+		bool finished     = false;
+		std::exception_ptr error;
+		std::mutex mutex;
+		std::condition_variable changed;
+	};
+
+	/// Wait in the target until a descriptor is readable or a second has passed.
+	bool wait_readable(target & target, int fd, std::uintptr_t scratch) {
+		pollfd poll = {fd, POLLIN, 0};
+		target.copy_to(scratch, &poll, sizeof(poll));
+		long result = target.syscall(7, {{scratch, 1, 1000, 0, 0, 0}});
+		if (result < 0) throw dbpp::error(target.pid(), {int(-result), std::generic_category()}, "Failed to execute poll system call in traced process");
+		return result > 0;
+	}
+
+	/// Read data from the target, stopping at end of file or when no data is available.
+	/**
+	 * The target is never left blocking in a read: sockets are read with MSG_DONTWAIT,
+	 * and other blocking descriptors are polled before every read.
+	 */
+	std::uint64_t read_loop(target & target, int fd, fd_info const & info, double_buffer & buffers, std::uintptr_t remote, std::uintptr_t scratch, extract_options const & options) {
+		bool socket    = info.type == fd_type::stream_socket || info.type == fd_type::datagram_socket;
+		bool peek      = options.peek && socket;
+		bool may_block = !socket && !(info.flags & O_NONBLOCK);
+		unsigned int flags = MSG_DONTWAIT | (peek ? MSG_PEEK : 0);
+
+		std::uint64_t total = 0;
+		while (!options.length || total < options.length) {
+			std::size_t wanted = options.buffer_size;
+			if (options.length) wanted = std::min<std::uint64_t>(wanted, options.length - total);
+
+			// Get a local buffer first, so data is never read out of the descriptor without a place to put it.
+			std::uint8_t * local = buffers.acquire();
+			if (!local) break;
+
+			if (may_block && !wait_readable(target, fd, scratch)) break;
+
+			long result;
+			if (socket) {
+				result = target.syscall(45, {{unsigned(fd), remote, wanted, flags, 0, 0}});
+			} else {
+				result = target.syscall(0, {{unsigned(fd), remote, wanted, 0, 0, 0}});
+			}
+
+			if (result == -EAGAIN || result == -EWOULDBLOCK) {
+				if (peek || !wait_readable(target, fd, scratch)) break;
+				continue;
+			}
+			if (result < 0) throw dbpp::error(target.pid(), {int(-result), std::generic_category()}, "Failed to execute read system call in traced process");
+			if (result == 0) break;
+
+			target.copy_from(local, remote, result);
+			buffers.publish(result);
+			total += result;
+
+			// Peeking again would return the same data.
+			if (peek) break;
+		}
+
+		return total;
+	}
+}
+
+/// Read data from a file descriptor of a target.
+std::uint64_t extract_data(target & target, int fd, extract_sink const & sink, extract_options const & options, std::ostream * log) {
+	int pid = target.pid();
+
+	std::size_t buffer_size  = std::max<std::size_t>(options.buffer_size, 1);
+	std::size_t mapping_size = buffer_size + fd_scratch_size;
+	long remote = mmap(target, 0, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, 0, 0);
+	if (remote < 0) throw dbpp::error(pid, {int(-remote), std::generic_category()}, "Failed to allocate memory in process");
+	std::uintptr_t scratch = remote + buffer_size;
+
+	extract_options effective = options;
+	effective.buffer_size = buffer_size;
+
+	double_buffer buffers(buffer_size);
+	std::thread consumer([&] () { buffers.consume(sink); });
+
+	std::uint64_t total = 0;
+	auto start = std::chrono::steady_clock::now();
+	try {
+		fd_info info = classify(target, fd, scratch);
+		if (log) *log << "Descriptor " << fd << " is a " << to_string(info.type) << " (" << info.path << ").\n";
+		total = read_loop(target, fd, info, buffers, remote, scratch, effective);
+	} catch (...) {
+		buffers.finish();
+		consumer.join();
+		munmap(target, remote, mapping_size);
+		throw;
+	}
+	buffers.finish();
+	consumer.join();
+	buffers.check();
+
+	if (log) {
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		*log << "Extracted " << total << " bytes in " << seconds * 1e3 << " ms";
+		if (seconds > 0) *log << " (" << total / seconds / (1 << 20) << " MiB/s)";
+		*log << ".\n";
+	}
+
+	int result = munmap(target, remote, mapping_size);
+	if (result < 0) throw dbpp::error(pid, {int(-result), std::generic_category()}, "Failed to deallocate memory in process");
+	return total;
+}
+
+}
@@ -0,0 +1,64 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+
+#include "target.hpp"
+
+namespace fdinject {
+
+/// Options for extracting data from a descriptor of a target.
+struct extract_options {
+	/// The size of the remote buffer and of each local buffer.
+	std::size_t buffer_size = 1 << 20;
+
+	/// The maximum number of bytes to extract, or 0 for no limit.
+	std::uint64_t length = 0;
+
+	/// Peek at the data of a socket with a single recv(MSG_PEEK), leaving it in the socket.
+	bool peek = false;
+};
+
+/// Function that receives extracted data.
+/**
+ * Called from a separate thread, in order.
+ */
+using extract_sink = std::function<void (void const * data, std::size_t length)>;
+
+/// Read data from a file descriptor of a target.
+/**
+ * The target reads into a remote buffer, which is copied out in bulk with process_vm_readv.
+ * The data is passed to the sink from a separate thread with two local buffers,
+ * so the next remote read overlaps with the sink handling the previous block.
+ *
+ * Reading stops at end of file, when the length is reached,
+ * or when the descriptor has no data available for a second.
+ * Progress and throughput are reported to log, if it is not null.
+ *
+ * \return The number of bytes extracted.
+ * Throws on failure.
+ */
+std::uint64_t extract_data(target & target, int fd, extract_sink const & sink, extract_options const & options = extract_options(), std::ostream * log = nullptr);
+
+}
@@ -0,0 +1,95 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <unistd.h>
+}
+
+#include "inject.hpp"
+
+namespace {
+
+void usage(char const * name) {
+	std::cerr << "Usage: " << name << " [--peek] [--length bytes] [--buffer-size bytes] [--record log] [--timeout ms] [--colocate] pid fd\n";
+}
+
+/// Write a block of data to standard output.
+void write_stdout(void const * data, std::size_t length) {
+	char const * position = static_cast<char const *>(data);
+	while (length) {
+		ssize_t result = ::write(STDOUT_FILENO, position, length);
+		if (result < 0 && errno == EINTR) continue;
+		if (result < 0) throw std::system_error(errno, std::system_category(), "Failed to write to standard output");
+		position += result;
+		length   -= result;
+	}
+}
+
+}
+
+int main(int argc, char * * argv) {
+	fdinject::session_options session_options;
+	session_options.log = &std::cerr;
+	fdinject::extract_options options;
+	std::vector<char const *> positional;
+
+	for (int i = 1; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--peek") == 0) {
+			options.peek = true;
+		} else if (std::strcmp(argv[i], "--length") == 0 && i + 1 < argc) {
+			options.length = std::stoull(argv[++i]);
+		} else if (std::strcmp(argv[i], "--buffer-size") == 0 && i + 1 < argc) {
+			options.buffer_size = std::stoull(argv[++i]);
+		} else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+			session_options.record = argv[++i];
+		} else if (std::strcmp(argv[i], "--colocate") == 0) {
+			session_options.colocate = true;
+		} else if (std::strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+			session_options.timeout = std::chrono::milliseconds(std::stoll(argv[++i]));
+		} else {
+			positional.push_back(argv[i]);
+		}
+	}
+
+	if (positional.size() != 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	int pid = std::stoi(positional[0]);
+	int fd  = std::stoi(positional[1]);
+
+	std::cerr << "Reading from descriptor " << fd << " of process " << pid << ".\n";
+
+	try {
+		fdinject::session session(pid, session_options);
+		session.extract(fd, write_stdout, options);
+		session.detach();
+	} catch (std::system_error const & e) {
+		std::cerr << "Error " << e.code().value() << ": " << e.what() << "\n";
+		return 1;
+	}
+}
@@ -0,0 +1,144 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+
+extern "C" {
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+#include "fdinfo.hpp"
+
+namespace fdinject {
+
+/// Get the name of a file descriptor type.
+char const * to_string(fd_type type) {
+	switch (type) {
+		case fd_type::unknown:         return "unknown";
+		case fd_type::regular:         return "regular file";
+		case fd_type::pipe:            return "pipe";
+		case fd_type::stream_socket:   return "stream socket";
+		case fd_type::datagram_socket: return "datagram socket";
+		case fd_type::other:           return "other";
+	}
+	return "unknown";
+}
+
+/// Get the name of a write strategy.
+char const * to_string(write_strategy strategy) {
+	switch (strategy) {
+		case write_strategy::write:    return "write";
+		case write_strategy::pwrite:   return "pwrite";
+		case write_strategy::vmsplice: return "vmsplice";
+		case write_strategy::send:     return "send";
+		case write_strategy::sendmsg:  return "sendmsg";
+	}
+	return "unknown";
+}
+
+/// Check if a system call number is one of the calls the write strategies use to write data.
+bool is_write_syscall(long number) {
+	return number == 1 || number == 18 || number == 44 || number == 46 || number == 278;
+}
+
+namespace {
+	std::string read_link(std::string const & path) {
+		char buffer[PATH_MAX];
+		ssize_t length = readlink(path.c_str(), buffer, sizeof(buffer));
+		if (length < 0) return "";
+		return std::string(buffer, length);
+	}
+
+	/// Parse the pos and flags fields of /proc/<pid>/fdinfo/<fd>.
+	void read_fdinfo(int pid, int fd, fd_info & info) {
+		std::ifstream file("/proc/" + std::to_string(pid) + "/fdinfo/" + std::to_string(fd));
+		std::string line;
+		while (std::getline(file, line)) {
+			std::istringstream stream(line);
+			std::string key;
+			stream >> key;
+			if (key == "pos:")   stream >> info.position;
+			if (key == "flags:") stream >> std::oct >> info.flags;
+		}
+	}
+
+	/// Make the target call getsockopt() for an integer option.
+	int remote_getsockopt(target & target, int fd, int option, std::uintptr_t scratch) {
+		std::uintptr_t value  = scratch;
+		std::uintptr_t length = scratch + sizeof(int);
+		int size = sizeof(int);
+		target.copy_to(length, &size, sizeof(size));
+
+		long result = target.syscall(55, {{unsigned(fd), SOL_SOCKET, unsigned(option), value, length, 0}});
+		if (result < 0) throw dbpp::error(target.pid(), {int(-result), std::generic_category()}, "Failed to execute getsockopt system call in traced process");
+
+		int output;
+		target.copy_from(&output, value, sizeof(output));
+		return output;
+	}
+}
+
+/// Classify a file descriptor of a target and choose a write strategy.
+fd_info classify(target & target, int fd, std::uintptr_t scratch) {
+	static_assert(sizeof(struct stat) <= fd_scratch_size, "Scratch memory is too small for struct stat.");
+
+	fd_info info;
+	int pid = target.pid();
+	info.path = read_link("/proc/" + std::to_string(pid) + "/fd/" + std::to_string(fd));
+	read_fdinfo(pid, fd, info);
+
+	long result = target.syscall(5, {{unsigned(fd), scratch, 0, 0, 0, 0}});
+	if (result < 0) throw dbpp::error(pid, {int(-result), std::generic_category()}, "Failed to execute fstat system call in traced process");
+
+	struct stat status;
+	target.copy_from(&status, scratch, sizeof(status));
+
+	if (S_ISREG(status.st_mode)) {
+		info.type = fd_type::regular;
+		// With O_APPEND, the kernel ignores the offset of pwrite.
+		if (!(info.flags & O_APPEND)) info.strategy = write_strategy::pwrite;
+	} else if (S_ISFIFO(status.st_mode)) {
+		info.type     = fd_type::pipe;
+		info.strategy = write_strategy::vmsplice;
+	} else if (S_ISSOCK(status.st_mode)) {
+		int type = remote_getsockopt(target, fd, SO_TYPE, scratch);
+		if (type == SOCK_STREAM) {
+			info.type     = fd_type::stream_socket;
+			info.strategy = write_strategy::send;
+		} else if (type == SOCK_DGRAM || type == SOCK_SEQPACKET) {
+			info.type     = fd_type::datagram_socket;
+			info.strategy = write_strategy::sendmsg;
+		} else {
+			info.type = fd_type::other;
+		}
+	} else {
+		info.type = fd_type::other;
+	}
+
+	info.classified = true;
+	return info;
+}
+
+}
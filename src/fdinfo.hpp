@@ -0,0 +1,94 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "target.hpp"
+
+namespace fdinject {
+
+/// The type of an open file descriptor.
+enum class fd_type {
+	unknown,
+	regular,
+	pipe,
+	stream_socket,
+	datagram_socket,
+	other,
+};
+
+/// The primitive used to write data to a file descriptor.
+enum class write_strategy {
+	write,    ///< write() in a loop, works for every descriptor.
+	pwrite,   ///< pwrite() at the tracked file offset, followed by a single lseek().
+	vmsplice, ///< vmsplice() the remote buffer into a pipe.
+	send,     ///< send() with MSG_NOSIGNAL to a stream socket.
+	sendmsg,  ///< A single sendmsg() per datagram.
+};
+
+/// Get the name of a file descriptor type.
+char const * to_string(fd_type type);
+
+/// Get the name of a write strategy.
+char const * to_string(write_strategy strategy);
+
+/// Check if a system call number is one of the calls the write strategies use to write data.
+/**
+ * These are write, pwrite64, sendto, sendmsg and vmsplice.
+ */
+bool is_write_syscall(long number);
+
+/// Information about a file descriptor of a target.
+struct fd_info {
+	/// True if the descriptor has been classified.
+	bool classified = false;
+
+	fd_type type = fd_type::unknown;
+
+	/// The target of /proc/<pid>/fd/<fd>.
+	std::string path;
+
+	/// The file offset from /proc/<pid>/fdinfo/<fd>.
+	std::uint64_t position = 0;
+
+	/// The file status flags from /proc/<pid>/fdinfo/<fd>.
+	int flags = 0;
+
+	/// The strategy chosen to write to the descriptor.
+	write_strategy strategy = write_strategy::write;
+};
+
+/// The number of bytes of scratch memory needed by classify() and by the write strategies.
+constexpr std::size_t fd_scratch_size = 256;
+
+/// Classify a file descriptor of a target and choose a write strategy.
+/**
+ * The descriptor is classified using /proc/<pid>/fd/<fd>, /proc/<pid>/fdinfo/<fd>, a remote fstat()
+ * and for sockets a remote getsockopt().
+ * Scratch must point to at least fd_scratch_size bytes of writable memory in the target.
+ *
+ * Throws on failure.
+ */
+fd_info classify(target & target, int fd, std::uintptr_t scratch);
+
+}
@@ -16,94 +16,213 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
 #include <sstream>
+#include <string>
 #include <vector>
 
-extern "C" {
-#include <sys/mman.h>
+#include "counters.hpp"
+#include "inject.hpp"
+#include "locate.hpp"
+#include "replay.hpp"
+
+namespace {
+
+void usage(char const * name) {
+	std::cout << "Usage: " << name << " [--record log] [--timeout ms] [--colocate] [--no-fast-path] pid fd\n";
+	std::cout << "       " << name << " [--record log] [--timeout ms] [--colocate] [--no-fast-path] --select selector\n";
+	std::cout << "       " << name << " [--record log] [--timeout ms] [--colocate] splice pid in_fd out_fd [length]\n";
+	std::cout << "       " << name << " replay [--drain-rate bytes/s] [--socket] [--buffer-size bytes] log\n";
+	std::cout << "       " << name << " locate selector\n";
+	std::cout << "\n";
+	std::cout << "A selector is tcp:LOCAL->REMOTE or tcp:LOCAL with endpoints like 10.0.0.1:443 or [::1]:443,\n";
+	std::cout << "inode:NUMBER for a socket or pipe, or path:PATH or an absolute path for a file or bound unix socket.\n";
 }
 
-#include "dbpp.hpp"
-#include "syscall.hpp"
+/// Start counting the impact of the session on the process, if perf events are available.
+std::unique_ptr<fdinject::impact_counters> start_counters(int pid) {
+	try {
+		return std::unique_ptr<fdinject::impact_counters>(new fdinject::impact_counters(pid));
+	} catch (std::system_error const & e) {
+		std::cout << "Not measuring impact on process: " << e.what() << "\n";
+		return nullptr;
+	}
+}
 
-namespace fdinject {
+void report_impact(fdinject::impact_counters const * counters) {
+	if (counters) std::cout << "Impact on process: " << counters->read() << ".\n";
+}
 
-#if !defined(__x86_64__)
-static_assert(false, "Unsupported architecture. At the moment, fdinject only support Linux on x86_64.");
-#endif
+int splice(char const * name, std::vector<char const *> const & positional, fdinject::session_options const & options) {
+	if (positional.size() != 4 && positional.size() != 5) {
+		usage(name);
+		return 1;
+	}
 
-long mmap(int pid, dbpp::register_t address, std::size_t length, int protection, int flags, int fd, std::size_t offset) {
-	return dbpp::syscall(pid, 9, {{address, length, unsigned(protection), unsigned(flags), unsigned(fd), offset}});
-}
+	int pid    = std::stoi(positional[1]);
+	int in_fd  = std::stoi(positional[2]);
+	int out_fd = std::stoi(positional[3]);
+	std::uint64_t length = positional.size() == 5 ? std::stoull(positional[4]) : 0;
+
+	std::cout << "Moving data from descriptor " << in_fd << " to descriptor " << out_fd << " of process " << pid << ".\n";
 
-int munmap(int pid, dbpp::register_t address, size_t length) {
-	return dbpp::syscall(pid, 11, {{address, length, 0, 0, 0, 0}});
+	try {
+		auto counters = start_counters(pid);
+		fdinject::session session(pid, options);
+		session.splice(in_fd, out_fd, length);
+		session.detach();
+		report_impact(counters.get());
+	} catch (std::system_error const & e) {
+		std::cout << "Error " << e.code().value() << ": " << e.what() << "\n";
+		return 1;
+	}
+	return 0;
 }
 
-int write(int pid, int fd, dbpp::register_t address, std::size_t length) {
-	return dbpp::syscall(pid, 1, {{unsigned(fd), address, length, 0, 0, 0}});
+/// Write data to descriptors of one process in a single session.
+void inject_process(int pid, std::vector<int> const & fds, std::string const & data, fdinject::session_options const & options) {
+	try {
+		auto counters = start_counters(pid);
+		auto start = std::chrono::steady_clock::now();
+		fdinject::session session(pid, options);
+		for (int fd : fds) {
+			// A failing descriptor does not stop the others, unless the session had to detach.
+			if (!session.attached()) break;
+			std::cout << "Writing to descriptor " << fd << " of process " << pid << ".\n";
+			try {
+				session.inject(fd, data.data(), data.size());
+			} catch (std::system_error const & e) {
+				std::cout << "Error " << e.code().value() << ": " << e.what() << "\n";
+			}
+		}
+		if (session.attached()) session.detach();
+		std::cout << "Attached for " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms.\n";
+		report_impact(counters.get());
+	} catch (std::system_error const & e) {
+		std::cout << "Error " << e.code().value() << ": " << e.what() << "\n";
+	}
 }
 
-void inject_data(int pid, int fd, void const * data, std::size_t length) {
-	std::cout << "Allocating memory in tracee.\n";
-	long address = mmap(pid, 0, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, 0, 0);
-	if (address < 0) throw dbpp::error(pid, {int(-address), std::generic_category()}, "Failed to allocate memory in process");
+int inject(int argc, char * * argv) {
+	fdinject::session_options options;
+	options.log = &std::cout;
+	std::vector<char const *> positional;
+	char const * select = nullptr;
+
+	for (int i = 1; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+			options.record = argv[++i];
+		} else if (std::strcmp(argv[i], "--no-fast-path") == 0) {
+			options.fast_path = false;
+		} else if (std::strcmp(argv[i], "--colocate") == 0) {
+			options.colocate = true;
+		} else if (std::strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+			options.timeout = std::chrono::milliseconds(std::stoll(argv[++i]));
+		} else if (std::strcmp(argv[i], "--select") == 0 && i + 1 < argc) {
+			select = argv[++i];
+		} else {
+			positional.push_back(argv[i]);
+		}
+	}
 
-	std::cout << "Copying memory to tracee.\n";
-	dbpp::memcpy_to(pid, address, data, length);
+	if (!select && !positional.empty() && std::strcmp(positional[0], "splice") == 0) return splice(argv[0], positional, options);
 
-	std::size_t written = 0;
-	while (written < length) {
-		int result = write(pid, fd, address + written, length - written);
-		if (result >= 0) {
-			std::cout << "Written " << result << " bytes.\n";
-			written += result;
-		} else {
-			std::cout << "write returned " << result << ".\n";
-			std::error_code error(-result, std::generic_category());
-			if (error != std::errc::resource_unavailable_try_again && error != std::errc::operation_would_block) {
-				throw dbpp::error(pid, error, "Failed to execute write system call in traced process.");
-			}
+	// The descriptors to write to, grouped by process.
+	std::map<int, std::vector<int>> targets;
+	if (select) {
+		if (!positional.empty()) {
+			usage(argv[0]);
+			return 1;
+		}
+		try {
+			for (auto const & location : fdinject::locate(fdinject::parse_selector(select))) targets[location.pid].push_back(location.fd);
+		} catch (std::system_error const & e) {
+			std::cout << "Error " << e.code().value() << ": " << e.what() << "\n";
+			return 1;
+		}
+		if (targets.empty()) {
+			std::cout << "No descriptors match " << select << ".\n";
+			return 1;
+		}
+	} else {
+		if (positional.size() != 2) {
+			usage(argv[0]);
+			return 1;
 		}
+		targets[std::stoi(positional[0])].push_back(std::stoi(positional[1]));
 	}
 
-	std::cout << "Deallocating memory in tracee.\n";
-	int result = munmap(pid, address, length);
-	if (result < 0) throw dbpp::error(pid, {int(-result), std::generic_category()}, "Failed to deallocate memory in process");
-}
+	std::string data;
+	{
+		std::stringstream buffer;
+		copy(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>(), std::ostreambuf_iterator<char>(buffer));
+		data = buffer.str();
+	}
 
+	for (auto const & target : targets) inject_process(target.first, target.second, data, options);
+	return 0;
 }
 
-int main(int argc, char * * argv) {
+int locate(int argc, char * * argv) {
 	if (argc != 3) {
-		std::cout << "Usage: " << argv[0] << " pid fd\n";
+		usage(argv[0]);
 		return 1;
 	}
 
-	int pid = std::stoi(argv[1]);
-	int fd  = std::stoi(argv[2]);
+	try {
+		auto start = std::chrono::steady_clock::now();
+		std::vector<fdinject::fd_location> locations = fdinject::locate(fdinject::parse_selector(argv[2]));
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		for (auto const & location : locations) std::cout << location.pid << " " << location.fd << "\n";
+		std::cerr << "Found " << locations.size() << " descriptors in " << milliseconds << " ms.\n";
+	} catch (std::system_error const & e) {
+		std::cerr << "Error " << e.code().value() << ": " << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}
 
-	std::cout << "Writing to descriptor " << fd << " of process " << pid << ".\n";
+int replay(int argc, char * * argv) {
+	fdinject::replay_options options;
+	std::vector<char const *> positional;
+
+	for (int i = 2; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--drain-rate") == 0 && i + 1 < argc) {
+			options.drain_rate = std::stoull(argv[++i]);
+		} else if (std::strcmp(argv[i], "--buffer-size") == 0 && i + 1 < argc) {
+			options.buffer_size = std::stoull(argv[++i]);
+		} else if (std::strcmp(argv[i], "--socket") == 0) {
+			options.socket = true;
+		} else {
+			positional.push_back(argv[i]);
+		}
+	}
 
-	std::string data;
-	{
-		std::stringstream buffer;
-		copy(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>(), std::ostreambuf_iterator<char>(buffer));
-		data = buffer.str();
+	if (positional.size() != 1) {
+		usage(argv[0]);
+		return 1;
 	}
+
 	try {
-		std::cout << "Attaching to process.\n";
-		dbpp::attach(pid);
-		std::cout << "Interrupting process.\n";
-		dbpp::kill(pid, dbpp::sigstop);
-		std::cout << "waiting for process to halt.\n";
-		dbpp::wait_for_trap(pid);
-		std::cout << "Starting remote write.\n";
-		fdinject::inject_data(pid, fd, data.data(), data.size());
-		std::cout << "Detaching from process.\n";
-		dbpp::detach(pid);
+		fdinject::replay(fdinject::read_log(positional[0]), options, std::cout);
 	} catch (std::system_error const & e) {
 		std::cout << "Error " << e.code().value() << ": " << e.what() << "\n";
+		return 1;
 	}
+	return 0;
+}
+
+}
+
+int main(int argc, char * * argv) {
+	if (argc >= 2 && std::strcmp(argv[1], "replay") == 0) return replay(argc, argv);
+	if (argc >= 2 && std::strcmp(argv[1], "locate") == 0) return locate(argc, argv);
+	return inject(argc, argv);
 }
@@ -0,0 +1,101 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+/*
+ * C interface to the fdinject injection engine.
+ *
+ * No C++ exceptions cross this interface.
+ * All functions return FDINJECT_OK on success or one of the negative fdinject_status values on failure.
+ * Details of the last failure in the calling thread can be retrieved with fdinject_last_errno() and fdinject_last_error().
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Status codes returned by the C interface.
+typedef enum fdinject_status {
+	FDINJECT_OK                  =  0, ///< The operation succeeded.
+	FDINJECT_ERROR_INVALID       = -1, ///< An invalid argument was passed.
+	FDINJECT_ERROR_SYSTEM        = -2, ///< A system call failed, see fdinject_last_errno().
+	FDINJECT_ERROR_TERMINATED    = -3, ///< The target process terminated.
+	FDINJECT_ERROR_SIGNAL        = -4, ///< The target process received an unexpected signal.
+	FDINJECT_ERROR_NO_MEMORY     = -5, ///< Memory allocation failed in the calling process.
+	FDINJECT_ERROR_UNKNOWN       = -6, ///< An unknown error occured.
+} fdinject_status;
+
+/// An opaque injection session.
+typedef struct fdinject_session fdinject_session;
+
+/// Statistics of the payload cache of a session.
+typedef struct fdinject_cache_stats {
+	unsigned long long hits;      ///< The number of injections that reused a cached payload.
+	unsigned long long misses;    ///< The number of injections that copied the payload to the process.
+	unsigned long long evictions; ///< The number of payloads evicted to stay within the budget.
+	size_t entries;               ///< The number of payloads currently cached.
+	size_t resident;              ///< The memory in the process currently used by cached payloads.
+} fdinject_cache_stats;
+
+/// Attach to and stop a process.
+/**
+ * On success, *session is set to a new session that must be released with fdinject_detach().
+ */
+fdinject_status fdinject_attach(int pid, fdinject_session ** session);
+
+/// Attach to and stop a process, keeping injected payloads in memory of the process for reuse.
+/**
+ * Payloads are cached by content in up to cache_budget bytes of memory of the process,
+ * so injecting the same payload again skips copying it.
+ * Small payloads are written through the stack the first time and only cached once they are injected again.
+ * The memory is freed by fdinject_detach().
+ * On success, *session is set to a new session that must be released with fdinject_detach().
+ */
+fdinject_status fdinject_attach_cached(int pid, size_t cache_budget, fdinject_session ** session);
+
+/// Write a block of data to a file descriptor of the traced process.
+fdinject_status fdinject_inject(fdinject_session * session, int fd, void const * data, size_t length);
+
+/// Detach from the process and release the session.
+/**
+ * The session is released even if detaching fails.
+ */
+fdinject_status fdinject_detach(fdinject_session * session);
+
+/// Get the process ID of a session.
+int fdinject_pid(fdinject_session const * session);
+
+/// Get the statistics of the payload cache of a session.
+fdinject_status fdinject_get_cache_stats(fdinject_session const * session, fdinject_cache_stats * stats);
+
+/// Get the system error number of the last failure in the calling thread, or 0 if there was none.
+int fdinject_last_errno(void);
+
+/// Get a description of the last failure in the calling thread.
+/**
+ * The returned string remains valid until the next call into this interface from the same thread.
+ */
+char const * fdinject_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,150 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <iostream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+}
+
+#include "inject.hpp"
+#include "maps.hpp"
+#include "snapshot.hpp"
+
+namespace {
+
+void usage(char const * name) {
+	std::cout << "Usage: " << name << " [options] pid output\n";
+	std::cout << "\n";
+	std::cout << "Options:\n";
+	std::cout << "  --perms PERMS   Only include regions with at least these permissions, for example rw.\n";
+	std::cout << "  --name NAME     Only include regions whose name contains NAME. May be given multiple times.\n";
+	std::cout << "  --threads N     Number of worker threads (default 4).\n";
+	std::cout << "  --live          Do not stop the process while taking the snapshot.\n";
+}
+
+/// The snapshot file, closed when it goes out of scope.
+struct output_file {
+	int fd = -1;
+
+	~output_file() {
+		if (fd >= 0) close(fd);
+	}
+};
+
+/// Check if a region matches the filters given on the command line.
+bool matches(dbpp::memory_region const & region, std::string const & permissions, std::vector<std::string> const & names) {
+	if (!region.readable) return false;
+	for (char c : permissions) {
+		if (c == 'w' && !region.writable)   return false;
+		if (c == 'x' && !region.executable) return false;
+		if (c == 's' && !region.shared)     return false;
+		if (c == 'p' &&  region.shared)     return false;
+	}
+
+	if (names.empty()) return true;
+	for (auto const & name : names) {
+		if (region.name.find(name) != std::string::npos) return true;
+	}
+	return false;
+}
+
+}
+
+int main(int argc, char * * argv) {
+	std::string permissions;
+	std::vector<std::string> names;
+	dbpp::snapshot_options options;
+	bool live = false;
+	std::vector<char const *> positional;
+
+	for (int i = 1; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--perms") == 0 && i + 1 < argc) {
+			permissions = argv[++i];
+		} else if (std::strcmp(argv[i], "--name") == 0 && i + 1 < argc) {
+			names.push_back(argv[++i]);
+		} else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			options.threads = std::stoi(argv[++i]);
+		} else if (std::strcmp(argv[i], "--live") == 0) {
+			live = true;
+		} else {
+			positional.push_back(argv[i]);
+		}
+	}
+
+	if (positional.size() != 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	int pid = std::stoi(positional[0]);
+	std::string output = positional[1];
+
+	try {
+		output_file file;
+		file.fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if (file.fd < 0) throw std::system_error(errno, std::system_category(), "Failed to open " + output);
+
+		std::vector<dbpp::snapshot_region> index;
+		dbpp::snapshot_stats stats;
+		std::chrono::steady_clock::duration paused{0};
+		auto start = std::chrono::steady_clock::now();
+		{
+			std::unique_ptr<fdinject::session> session;
+			if (!live) session.reset(new fdinject::session(pid));
+			auto stopped = std::chrono::steady_clock::now();
+
+			std::vector<dbpp::memory_region> regions;
+			for (auto const & region : dbpp::read_memory_map(pid)) {
+				if (matches(region, permissions, names)) regions.push_back(region);
+			}
+
+			stats = dbpp::snapshot(pid, regions, file.fd, index, options);
+
+			if (session) {
+				session->detach();
+				paused = std::chrono::steady_clock::now() - stopped;
+			}
+		}
+		auto elapsed = std::chrono::steady_clock::now() - start;
+
+		std::ofstream index_file(output + ".index");
+		dbpp::write_snapshot_index(index_file, index);
+		if (!index_file) throw std::system_error(errno, std::system_category(), "Failed to write " + output + ".index");
+
+		double seconds = std::chrono::duration<double>(elapsed).count();
+		std::cout << "Regions:    " << index.size() << "\n";
+		std::cout << "Read:       " << stats.bytes_read << " bytes (" << stats.bytes_read / seconds / (1 << 20) << " MiB/s)\n";
+		std::cout << "Zero:       " << stats.bytes_zero << " bytes\n";
+		std::cout << "Unreadable: " << stats.bytes_unreadable << " bytes\n";
+		std::cout << "File size:  " << stats.file_size << " bytes\n";
+		std::cout << "Elapsed:    " << seconds * 1e3 << " ms\n";
+		if (!live) std::cout << "Paused:     " << std::chrono::duration<double, std::milli>(paused).count() << " ms\n";
+	} catch (std::system_error const & e) {
+		std::cout << "Error " << e.code().value() << ": " << e.what() << "\n";
+		return 1;
+	}
+}
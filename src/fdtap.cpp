@@ -0,0 +1,119 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+}
+
+#include "inject.hpp"
+
+namespace {
+
+std::atomic<bool> stop{false};
+
+void usage(char const * name) {
+	std::cerr << "Usage: " << name << " [--record log] [--no-new-privs] pid fd [output]\n";
+}
+
+void handle_stop(int) {
+	stop = true;
+}
+
+/// Write a block of data to a file descriptor.
+void write_all(int fd, void const * data, std::size_t length) {
+	char const * position = static_cast<char const *>(data);
+	while (length) {
+		ssize_t result = ::write(fd, position, length);
+		if (result < 0 && errno == EINTR) continue;
+		if (result < 0) throw std::system_error(errno, std::system_category(), "Failed to write output");
+		position += result;
+		length   -= result;
+	}
+}
+
+}
+
+int main(int argc, char * * argv) {
+	fdinject::session_options session_options;
+	session_options.log = &std::cerr;
+	bool no_new_privs = false;
+	std::vector<char const *> positional;
+
+	for (int i = 1; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+			session_options.record = argv[++i];
+		} else if (std::strcmp(argv[i], "--no-new-privs") == 0) {
+			no_new_privs = true;
+		} else {
+			positional.push_back(argv[i]);
+		}
+	}
+
+	if (positional.size() != 2 && positional.size() != 3) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	int pid = std::stoi(positional[0]);
+	int fd  = std::stoi(positional[1]);
+
+	int output = STDOUT_FILENO;
+	if (positional.size() == 3) {
+		output = ::open(positional[2], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+		if (output < 0) {
+			std::cerr << "Failed to open " << positional[2] << ": " << std::strerror(errno) << "\n";
+			return 1;
+		}
+	}
+
+	// The filter stays in the target, so interrupting only stops the output. The tracer keeps running until the target exits.
+	struct sigaction action = {};
+	action.sa_handler = handle_stop;
+	sigaction(SIGINT, &action, nullptr);
+	sigaction(SIGTERM, &action, nullptr);
+	signal(SIGPIPE, SIG_IGN);
+
+	std::cerr << "Tapping descriptor " << fd << " of process " << pid << ".\n";
+
+	try {
+		fdinject::session session(pid, session_options);
+		auto sink = [output] (void const * data, std::size_t length) {
+			try {
+				write_all(output, data, length);
+			} catch (std::system_error const & e) {
+				std::cerr << "Error " << e.code().value() << ": " << e.what() << ", no longer writing output.\n";
+				stop = true;
+			}
+		};
+		fdinject::tap_stats stats = session.tap(fd, sink, stop, no_new_privs);
+		std::cerr << "Process exited after " << stats.calls << " tapped system calls, " << stats.bytes << " bytes captured.\n";
+	} catch (std::system_error const & e) {
+		std::cerr << "Error " << e.code().value() << ": " << e.what() << "\n";
+		return 1;
+	}
+}
@@ -0,0 +1,115 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cstring>
+
+#include "hash.hpp"
+
+namespace fdinject {
+
+namespace {
+	constexpr std::uint64_t prime1 = 11400714785074694791ULL;
+	constexpr std::uint64_t prime2 = 14029467366897019727ULL;
+	constexpr std::uint64_t prime3 =  1609587929392839161ULL;
+	constexpr std::uint64_t prime4 =  9650029242287828579ULL;
+	constexpr std::uint64_t prime5 =  2870177450012600261ULL;
+
+	std::uint64_t rotate_left(std::uint64_t value, int bits) {
+		return (value << bits) | (value >> (64 - bits));
+	}
+
+	std::uint64_t read64(std::uint8_t const * data) {
+		std::uint64_t result;
+		std::memcpy(&result, data, sizeof(result));
+		return result;
+	}
+
+	std::uint32_t read32(std::uint8_t const * data) {
+		std::uint32_t result;
+		std::memcpy(&result, data, sizeof(result));
+		return result;
+	}
+
+	std::uint64_t round(std::uint64_t accumulator, std::uint64_t input) {
+		accumulator += input * prime2;
+		accumulator  = rotate_left(accumulator, 31);
+		return accumulator * prime1;
+	}
+
+	std::uint64_t merge_round(std::uint64_t accumulator, std::uint64_t value) {
+		accumulator ^= round(0, value);
+		return accumulator * prime1 + prime4;
+	}
+}
+
+/// Compute the 64 bit xxHash of a block of data.
+std::uint64_t hash64(void const * data, std::size_t length, std::uint64_t seed) {
+	std::uint8_t const * input = static_cast<std::uint8_t const *>(data);
+	std::uint8_t const * end   = input + length;
+	std::uint64_t hash;
+
+	if (length >= 32) {
+		std::uint64_t v1 = seed + prime1 + prime2;
+		std::uint64_t v2 = seed + prime2;
+		std::uint64_t v3 = seed;
+		std::uint64_t v4 = seed - prime1;
+
+		for (; input + 32 <= end; input += 32) {
+			v1 = round(v1, read64(input));
+			v2 = round(v2, read64(input + 8));
+			v3 = round(v3, read64(input + 16));
+			v4 = round(v4, read64(input + 24));
+		}
+
+		hash = rotate_left(v1, 1) + rotate_left(v2, 7) + rotate_left(v3, 12) + rotate_left(v4, 18);
+		hash = merge_round(hash, v1);
+		hash = merge_round(hash, v2);
+		hash = merge_round(hash, v3);
+		hash = merge_round(hash, v4);
+	} else {
+		hash = seed + prime5;
+	}
+
+	hash += length;
+
+	for (; input + 8 <= end; input += 8) {
+		hash ^= round(0, read64(input));
+		hash  = rotate_left(hash, 27) * prime1 + prime4;
+	}
+
+	if (input + 4 <= end) {
+		hash ^= std::uint64_t(read32(input)) * prime1;
+		hash  = rotate_left(hash, 23) * prime2 + prime3;
+		input += 4;
+	}
+
+	for (; input < end; ++input) {
+		hash ^= *input * prime5;
+		hash  = rotate_left(hash, 11) * prime1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= prime2;
+	hash ^= hash >> 29;
+	hash *= prime3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+}
@@ -0,0 +1,461 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+}
+
+#include "inject.hpp"
+#include "splice.hpp"
+
+namespace fdinject {
+
+#if !defined(__x86_64__)
+static_assert(false, "Unsupported architecture. At the moment, fdinject only support Linux on x86_64.");
+#endif
+
+long mmap(target & target, dbpp::register_t address, std::size_t length, int protection, int flags, int fd, std::size_t offset) {
+	return target.syscall(9, {{address, length, unsigned(protection), unsigned(flags), unsigned(fd), offset}});
+}
+
+int munmap(target & target, dbpp::register_t address, std::size_t length) {
+	return target.syscall(11, {{address, length, 0, 0, 0, 0}});
+}
+
+long write(target & target, int fd, dbpp::register_t address, std::size_t length) {
+	return target.syscall(1, {{unsigned(fd), address, length, 0, 0, 0}});
+}
+
+namespace {
+	bool would_block(std::error_code const & error) {
+		return error == std::errc::resource_unavailable_try_again || error == std::errc::operation_would_block;
+	}
+
+	/// Check if an error means a write strategy is not supported for a descriptor.
+	bool unsupported(std::error_code const & error) {
+		return error == std::errc::invalid_argument
+			|| error == std::errc::function_not_supported
+			|| error == std::errc::operation_not_supported
+			|| error == std::errc::invalid_seek;
+	}
+
+	/// Write part of the remote buffer with the chosen strategy.
+	/**
+	 * Offset is the number of bytes already written, used to compute the file offset for pwrite.
+	 * Scratch must point to fd_scratch_size bytes of writable memory in the target.
+	 */
+	long write_once(target & target, int fd, fd_info const & info, std::uintptr_t address, std::size_t length, std::uint64_t offset, std::uintptr_t scratch) {
+		bool non_blocking = info.flags & O_NONBLOCK;
+		unsigned int send_flags = MSG_NOSIGNAL | (non_blocking ? MSG_DONTWAIT : 0);
+
+		switch (info.strategy) {
+			case write_strategy::write:
+				break;
+
+			case write_strategy::pwrite:
+				return target.syscall(18, {{unsigned(fd), address, length, info.position + offset, 0, 0}});
+
+			case write_strategy::vmsplice: {
+				iovec iov = {reinterpret_cast<void *>(address), length};
+				target.copy_to(scratch, &iov, sizeof(iov));
+				return target.syscall(278, {{unsigned(fd), scratch, 1, non_blocking ? SPLICE_F_NONBLOCK : 0u, 0, 0}});
+			}
+
+			case write_strategy::send:
+				return target.syscall(44, {{unsigned(fd), address, length, send_flags, 0, 0}});
+
+			case write_strategy::sendmsg: {
+				struct {
+					iovec iov;
+					msghdr message;
+				} remote = {};
+				remote.iov.iov_base        = reinterpret_cast<void *>(address);
+				remote.iov.iov_len         = length;
+				remote.message.msg_iov     = reinterpret_cast<iovec *>(scratch);
+				remote.message.msg_iovlen  = 1;
+				target.copy_to(scratch, &remote, sizeof(remote));
+				return target.syscall(46, {{unsigned(fd), scratch + offsetof(decltype(remote), message), send_flags, 0, 0, 0}});
+			}
+		}
+
+		return write(target, fd, address, length);
+	}
+}
+
+namespace {
+	/// Write a payload in memory of the target to a file descriptor.
+	/**
+	 * Scratch must point to fd_scratch_size bytes of writable memory in the target.
+	 * If transient is true, the memory is reused by the caller afterwards,
+	 * so strategies that keep referring to it after the system call returned are not used.
+	 */
+	void write_payload(target & target, int fd, std::uintptr_t address, std::size_t length, std::uintptr_t scratch, bool transient, std::ostream * log, fd_info & info) {
+		int pid = target.pid();
+
+		if (!info.classified) {
+			info = classify(target, fd, scratch);
+			if (log) *log << "Descriptor " << fd << " is a " << to_string(info.type) << " (" << info.path << "), using " << to_string(info.strategy) << ".\n";
+		}
+
+		// vmsplice references the pages instead of copying them, and pwrite needs an lseek afterwards.
+		fd_info used = info;
+		if (transient && (used.strategy == write_strategy::vmsplice || used.strategy == write_strategy::pwrite)) {
+			used.strategy = write_strategy::write;
+			if (log) *log << "Using write for small payload.\n";
+		}
+
+		// Keep the cached file offset up to date. pwrite doesn't move the file offset, so move it like write would have.
+		std::size_t written = 0;
+		auto advance = [&] () {
+			if (info.type == fd_type::regular) info.position += written;
+			if (used.strategy != write_strategy::pwrite) return;
+			long result = target.syscall(8, {{unsigned(fd), info.position, SEEK_SET, 0, 0, 0}});
+			if (result < 0) throw dbpp::error(pid, {int(-result), std::generic_category()}, "Failed to execute lseek system call in traced process.");
+		};
+
+		auto start = std::chrono::steady_clock::now();
+		try {
+			while (written < length) {
+				long result = write_once(target, fd, used, address + written, length - written, written, scratch);
+				if (result >= 0) {
+					if (log) *log << "Written " << result << " bytes.\n";
+					written += result;
+				} else {
+					if (log) *log << to_string(used.strategy) << " returned " << result << ".\n";
+					std::error_code error(-result, std::generic_category());
+					if (written == 0 && used.strategy != write_strategy::write && unsupported(error)) {
+						if (log) *log << "Falling back to write.\n";
+						used.strategy = write_strategy::write;
+						info.strategy = write_strategy::write;
+					} else if (!would_block(error)) {
+						throw dbpp::error(pid, error, "Failed to execute write system call in traced process.");
+					}
+				}
+			}
+		} catch (...) {
+			// Account for the part that was written, so the next write doesn't overwrite it. The original error is more relevant.
+			if (written) {
+				try { advance(); } catch (...) {}
+			}
+			throw;
+		}
+		advance();
+
+		if (log) {
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			*log << "Wrote " << written << " bytes with " << to_string(used.strategy) << " in " << seconds * 1e3 << " ms";
+			if (seconds > 0) *log << " (" << written / seconds / (1 << 20) << " MiB/s)";
+			*log << ".\n";
+		}
+	}
+
+	/// Round up to a multiple of 16 bytes.
+	std::size_t align16(std::size_t size) {
+		return (size + 15) / 16 * 16;
+	}
+}
+
+void inject_data(target & target, int fd, void const * data, std::size_t length, std::ostream * log, fd_info * info) {
+	static_assert(sizeof(iovec) + sizeof(msghdr) <= fd_scratch_size, "Scratch memory is too small for sendmsg arguments.");
+
+	int pid = target.pid();
+
+	// Reserve scratch memory for system call arguments after the payload.
+	std::size_t mapping_size = resident_size(length);
+
+	if (log) *log << "Allocating memory in tracee.\n";
+	long address = mmap(target, 0, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, 0, 0);
+	if (address < 0) throw dbpp::error(pid, {int(-address), std::generic_category()}, "Failed to allocate memory in process");
+
+	try {
+		if (log) *log << "Copying memory to tracee.\n";
+		target.copy_to(address, data, length);
+		inject_resident(target, fd, address, length, log, info);
+	} catch (dbpp::deadline_exceeded const &) {
+		// The process may have an interrupt pending and can't be used any further, so the memory is left behind.
+		throw;
+	} catch (...) {
+		munmap(target, address, mapping_size);
+		throw;
+	}
+
+	if (log) *log << "Deallocating memory in tracee.\n";
+	int result = munmap(target, address, mapping_size);
+	if (result < 0) throw dbpp::error(pid, {int(-result), std::generic_category()}, "Failed to deallocate memory in process");
+}
+
+std::size_t resident_size(std::size_t length) {
+	return align16(length) + fd_scratch_size;
+}
+
+void inject_resident(target & target, int fd, std::uintptr_t address, std::size_t length, std::ostream * log, fd_info * info) {
+	fd_info local_info;
+	write_payload(target, fd, address, length, address + align16(length), false, log, info ? *info : local_info);
+}
+
+std::size_t stack_area_size(std::size_t length) {
+	return resident_size(length);
+}
+
+std::uintptr_t find_stack_area(dbpp::memory_region const & stack, std::uintptr_t stack_pointer, std::size_t length) {
+	std::size_t size = stack_area_size(length);
+	if (!stack.writable || !stack.contains(stack_pointer) || stack_pointer - stack.start < stack_red_zone + size) return 0;
+	return (stack_pointer - stack_red_zone - size) & ~std::uintptr_t(15);
+}
+
+void inject_data_on_stack(target & target, int fd, void const * data, std::size_t length, std::uintptr_t area, std::ostream * log, fd_info * info) {
+	std::size_t size = stack_area_size(length);
+	std::vector<std::uint8_t> saved(size);
+
+	if (log) *log << "Using " << size << " bytes of stack memory at 0x" << std::hex << area << std::dec << ".\n";
+	target.copy_from(saved.data(), area, size);
+
+	fd_info local_info;
+	try {
+		if (log) *log << "Copying memory to tracee.\n";
+		target.copy_to(area, data, length);
+		write_payload(target, fd, area, length, area + align16(length), true, log, info ? *info : local_info);
+	} catch (...) {
+		target.copy_to(area, saved.data(), size);
+		throw;
+	}
+
+	if (log) *log << "Restoring stack memory.\n";
+	target.copy_to(area, saved.data(), size);
+}
+
+session::session(int pid, session_options const & options) : pid_(pid), attached_(false), log_(options.log), timeout_(options.timeout), fast_path_(options.fast_path), stack(), cache(options.cache_budget), traced(pid) {
+	if (!options.record.empty()) {
+		recorder_.reset(new recorder(options.record));
+		recording.reset(new recording_target(traced, *recorder_));
+	}
+
+	auto start = recorder::clock::now();
+	if (log_) *log_ << "Attaching to process.\n";
+	dbpp::attach(pid_);
+	attached_ = true;
+
+	try {
+		if (log_) *log_ << "Interrupting process.\n";
+		dbpp::kill(pid_, dbpp::sigstop);
+		if (log_) *log_ << "waiting for process to halt.\n";
+		dbpp::wait_for_trap(pid_, deadline());
+		if (recorder_) recorder_->event(record_type::attach, start, recorder::clock::now());
+		if (options.colocate) colocate();
+	} catch (dbpp::deadline_exceeded const &) {
+		// Discard the pending stop signal, or the process stops as soon as it wakes up, without anyone to resume it.
+		if (log_) *log_ << "Process did not halt in time, detaching.\n";
+		try { dbpp::detach(pid_); } catch (...) {}
+		try { dbpp::kill(pid_, dbpp::sigcont); } catch (...) {}
+		attached_ = false;
+		throw;
+	} catch (...) {
+		try { dbpp::detach(pid_); } catch (...) {}
+		attached_ = false;
+		throw;
+	}
+}
+
+void session::colocate() {
+	// Measure with the plain traced target, so the samples don't end up in a recording.
+	auto before = measure_round_trip(traced);
+	colocation_.reset(new colocation(pid_, log_));
+	auto after = measure_round_trip(traced);
+	if (log_) *log_ << "Round trip latency " << std::chrono::duration<double, std::micro>(before).count() << " us before pinning, "
+		<< std::chrono::duration<double, std::micro>(after).count() << " us after pinning.\n";
+}
+
+std::uintptr_t session::cache_payload(void const * data, std::size_t length) {
+	if (log_) *log_ << "Payload cache miss, allocating memory in tracee.\n";
+	std::size_t size = resident_size(length);
+	long result = mmap(remote(), 0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, 0, 0);
+	if (result < 0) throw dbpp::error(pid_, {int(-result), std::generic_category()}, "Failed to allocate memory in process");
+	std::uintptr_t address = result;
+
+	try {
+		if (log_) *log_ << "Copying memory to tracee.\n";
+		remote().copy_to(address, data, length);
+	} catch (...) {
+		munmap(remote(), address, size);
+		throw;
+	}
+	release(cache.insert(data, length, address, size));
+	return address;
+}
+
+void session::release(std::vector<payload_cache::entry> const & entries) {
+	// Free as much as possible before reporting the first failure.
+	int error = 0;
+	for (auto const & entry : entries) {
+		int result = munmap(remote(), entry.address, entry.size);
+		if (result < 0 && !error) error = -result;
+	}
+	if (error) throw dbpp::error(pid_, {error, std::generic_category()}, "Failed to deallocate memory in process");
+}
+
+std::uintptr_t session::stack_area(std::size_t length) {
+	std::uintptr_t stack_pointer = dbpp::get_registers(pid_).sp;
+	std::uintptr_t area = find_stack_area(stack, stack_pointer, length);
+	if (area) return area;
+
+	// The stack pointer left the cached region or the stack grew, so look it up again.
+	std::vector<dbpp::memory_region> regions = dbpp::read_memory_map(pid_);
+	dbpp::memory_region const * region = dbpp::find_region(regions, stack_pointer);
+	if (!region) return 0;
+	stack = *region;
+	return find_stack_area(stack, stack_pointer, length);
+}
+
+dbpp::deadline_t session::deadline() const {
+	if (timeout_.count() <= 0) return dbpp::deadline_t::max();
+	return std::chrono::steady_clock::now() + timeout_;
+}
+
+template<typename F>
+auto session::bounded(F && operation) -> decltype(operation()) {
+	traced.set_deadline(deadline());
+	try {
+		return operation();
+	} catch (dbpp::deadline_exceeded const &) {
+		// The aborted system call may leave a ptrace interrupt pending, so the process can't be used any further.
+		// That includes freeing cached payloads, so they are left behind.
+		if (log_) *log_ << "Operation exceeded the timeout of " << timeout_.count() << " ms.\n";
+		if (log_ && cache.stats().entries) *log_ << "Leaving " << cache.stats().entries << " cached payloads behind.\n";
+		cache.clear();
+		try { detach(); } catch (...) {}
+		throw;
+	}
+}
+
+session::~session() {
+	if (!attached_) return;
+	try { detach(); } catch (...) {}
+}
+
+void session::inject(int fd, void const * data, std::size_t length) {
+	if (log_) *log_ << "Starting remote write.\n";
+	// Copy the payload to memory of the NUMA node the session is pinned to, where it is read from while copying it to the process.
+	std::vector<std::uint8_t> local;
+	if (colocation_) {
+		local.assign(static_cast<std::uint8_t const *>(data), static_cast<std::uint8_t const *>(data) + length);
+		data = local.data();
+	}
+
+	bounded([&] () {
+		bool cacheable = cache.fits(resident_size(length));
+		payload_cache::entry const * entry = cacheable ? cache.find(data, length) : nullptr;
+		if (entry && log_) *log_ << "Payload cache hit, reusing memory at 0x" << std::hex << entry->address << std::dec << ".\n";
+
+		// Until a small payload repeats, writing it through the stack is cheaper than allocating memory to cache it.
+		bool small = fast_path_ && length <= small_payload_limit;
+		std::uintptr_t area = 0;
+		if (!entry && small && (!cacheable || !cache.missed_before(data, length))) area = stack_area(length);
+
+		auto write = [&] () {
+			if (entry) {
+				inject_resident(remote(), fd, entry->address, length, log_, &descriptors[fd]);
+			} else if (area) {
+				inject_data_on_stack(remote(), fd, data, length, area, log_, &descriptors[fd]);
+			} else if (cacheable) {
+				inject_resident(remote(), fd, cache_payload(data, length), length, log_, &descriptors[fd]);
+			} else {
+				inject_data(remote(), fd, data, length, log_, &descriptors[fd]);
+			}
+		};
+
+		if (!recorder_) {
+			write();
+			return;
+		}
+
+		auto start = recorder::clock::now();
+		recorder_->inject(fd, data, length, start);
+		try {
+			write();
+		} catch (std::system_error const & e) {
+			recorder_->event(record_type::injected, start, recorder::clock::now(), -e.code().value());
+			throw;
+		}
+		recorder_->event(record_type::injected, start, recorder::clock::now());
+	});
+}
+
+std::uint64_t session::splice(int in_fd, int out_fd, std::uint64_t length) {
+	if (log_) *log_ << "Starting remote splice.\n";
+	return bounded([&] () { return splice_data(remote(), in_fd, out_fd, length, log_); });
+}
+
+std::uint64_t session::extract(int fd, extract_sink const & sink, extract_options const & options) {
+	if (log_) *log_ << "Starting remote read.\n";
+	return bounded([&] () { return extract_data(remote(), fd, sink, options, log_); });
+}
+
+tap_stats session::tap(int fd, extract_sink const & sink, std::atomic<bool> const & stop, bool no_new_privs) {
+	release(cache.clear());
+	std::vector<int> tasks = seize_tasks(pid_, log_);
+	try {
+		bounded([&] () { install_tap_filter(remote(), fd, no_new_privs, log_); });
+	} catch (...) {
+		release_tasks(tasks);
+		throw;
+	}
+	if (log_) *log_ << "Tapping descriptor " << fd << " until the process exits.\n";
+	tap_stats stats = run_tap(pid_, tasks, sink, stop, log_);
+	attached_ = false;
+	colocation_.reset();
+	if (recorder_) recorder_->event(record_type::detach, recorder::clock::now(), recorder::clock::now());
+	return stats;
+}
+
+void session::detach() {
+	if (cache.stats().entries) {
+		if (log_) *log_ << "Releasing " << cache.stats().entries << " cached payloads.\n";
+		// Still detach if freeing the memory fails.
+		try {
+			release(cache.clear());
+		} catch (std::system_error const & e) {
+			if (log_) *log_ << "Failed to release cached payloads: " << e.what() << "\n";
+		}
+	}
+	if (log_ && (cache.stats().hits || cache.stats().misses)) {
+		*log_ << "Payload cache: " << cache.stats().hits << " hits, " << cache.stats().misses << " misses, " << cache.stats().evictions << " evictions.\n";
+	}
+
+	if (log_) *log_ << "Detaching from process.\n";
+	attached_ = false;
+	colocation_.reset();
+	auto start = recorder::clock::now();
+	dbpp::detach(pid_);
+	if (recorder_) recorder_->event(record_type::detach, start, recorder::clock::now());
+}
+
+target & session::remote() {
+	if (recording) return *recording;
+	return traced;
+}
+
+}
@@ -0,0 +1,258 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "affinity.hpp"
+#include "cache.hpp"
+#include "dbpp.hpp"
+#include "extract.hpp"
+#include "fdinfo.hpp"
+#include "maps.hpp"
+#include "record.hpp"
+#include "tap.hpp"
+#include "target.hpp"
+
+namespace fdinject {
+
+/// Make a target call mmap.
+long mmap(target & target, dbpp::register_t address, std::size_t length, int protection, int flags, int fd, std::size_t offset);
+
+/// Make a target call munmap.
+int munmap(target & target, dbpp::register_t address, std::size_t length);
+
+/// Make a target call write.
+long write(target & target, int fd, dbpp::register_t address, std::size_t length);
+
+/// Write a block of data to a file descriptor of a target.
+/**
+ * The descriptor is classified to choose the best write strategy, unless info is already classified.
+ * If info is not null, the classification is stored in it for later injections.
+ * Progress, the chosen strategy and the write throughput are reported to log, if it is not null.
+ *
+ * Throws on failure.
+ */
+void inject_data(target & target, int fd, void const * data, std::size_t length, std::ostream * log = nullptr, fd_info * info = nullptr);
+
+/// Get the size of the remote memory needed by inject_resident() for a payload.
+std::size_t resident_size(std::size_t length);
+
+/// Write a block of data that is already in memory of a target to a file descriptor.
+/**
+ * The memory at address must be resident_size(length) bytes large, starting with the payload.
+ * The memory after the payload is used for system call arguments.
+ *
+ * Throws on failure.
+ */
+void inject_resident(target & target, int fd, std::uintptr_t address, std::size_t length, std::ostream * log = nullptr, fd_info * info = nullptr);
+
+/// Size of the area below the stack pointer that the x86_64 ABI reserves for leaf functions.
+constexpr std::size_t stack_red_zone = 128;
+
+/// Payloads up to this size are injected through stack memory of the target, if possible.
+constexpr std::size_t small_payload_limit = 512;
+
+/// Get the size of the stack memory needed by inject_data_on_stack() for a payload.
+std::size_t stack_area_size(std::size_t length);
+
+/// Find stack memory for inject_data_on_stack() below the red zone of a stack.
+/**
+ * \return The start of the area, or 0 if it doesn't fit in the stack region or the region is not writable.
+ */
+std::uintptr_t find_stack_area(dbpp::memory_region const & stack, std::uintptr_t stack_pointer, std::size_t length);
+
+/// Write a small block of data to a file descriptor of a stopped target, using its stack as temporary memory.
+/**
+ * Area must be stack memory found with find_stack_area() for the current stack pointer of the target.
+ * The original contents of the area are saved and restored afterwards,
+ * so this saves the remote mmap and munmap of inject_data() for the price of two memory copies.
+ * Because the memory is reused, the data is always written with a copying system call:
+ * pipes and regular files use write instead of vmsplice and pwrite.
+ *
+ * Throws on failure.
+ */
+void inject_data_on_stack(target & target, int fd, void const * data, std::size_t length, std::uintptr_t area, std::ostream * log = nullptr, fd_info * info = nullptr);
+
+/// Options for an injection session.
+struct session_options {
+	/// Stream to report progress to, or null.
+	std::ostream * log = nullptr;
+
+	/// Path of a session log to record the session to, or empty to disable recording.
+	std::string record;
+
+	/// Upper bound for stopping the process and for each operation, or zero for no limit.
+	/**
+	 * When an operation exceeds it, the pending system call is aborted,
+	 * the session detaches and dbpp::deadline_exceeded is thrown.
+	 */
+	std::chrono::milliseconds timeout{0};
+
+	/// If true, pin the calling thread close to the process for the duration of the session.
+	/**
+	 * See colocation for details. Operations on the session must then be performed from the thread that created it.
+	 * The ptrace round trip latency is reported before and after pinning.
+	 */
+	bool colocate = false;
+
+	/// If true, inject payloads up to small_payload_limit bytes through stack memory of the process.
+	bool fast_path = true;
+
+	/// The amount of memory in the process used to keep injected payloads for reuse, or zero to disable the cache.
+	/**
+	 * Payloads that fit are kept in memory of the process after they were injected,
+	 * so injecting the same payload again only costs the system calls to write it.
+	 * With the fast path enabled, small payloads are written through the stack the first time
+	 * and only cached once they are injected again.
+	 * The memory is freed when the session detaches, except after an operation exceeded the timeout.
+	 */
+	std::size_t cache_budget = 0;
+};
+
+/// An injection session with a single process.
+/**
+ * The session attaches to and stops the process when it is created,
+ * and detaches again when it is destroyed or when detach() is called.
+ */
+class session {
+public:
+	/// Attach to and stop a process.
+	/**
+	 * Throws on failure.
+	 */
+	explicit session(int pid, session_options const & options = session_options());
+
+	session(session const &) = delete;
+	session & operator= (session const &) = delete;
+
+	/// Detach from the process if that hasn't happened yet.
+	/**
+	 * Errors are silently ignored.
+	 */
+	~session();
+
+	/// The process ID of the traced process.
+	int pid() const { return pid_; }
+
+	/// True if the session is still attached to the process.
+	bool attached() const { return attached_; }
+
+	/// Write a block of data to a file descriptor of the process.
+	/**
+	 * Throws on failure.
+	 */
+	void inject(int fd, void const * data, std::size_t length);
+
+	/// Move data between two file descriptors of the process without copying it to user space.
+	/**
+	 * See splice_data() for details.
+	 * \return The number of bytes moved.
+	 * Throws on failure.
+	 */
+	std::uint64_t splice(int in_fd, int out_fd, std::uint64_t length);
+
+	/// Read data from a file descriptor of the process.
+	/**
+	 * See extract_data() for details.
+	 * \return The number of bytes extracted.
+	 * Throws on failure.
+	 */
+	std::uint64_t extract(int fd, extract_sink const & sink, extract_options const & options = extract_options());
+
+	/// Pass everything the process writes to a file descriptor to a sink, until the process exits.
+	/**
+	 * See install_tap_filter() and run_tap() for details.
+	 * All threads of the process are attached to before the filter is installed.
+	 * If no_new_privs is true, it is set in the process if that is needed to install the filter.
+	 * The filter can not be removed, so the session stays attached until all tasks of the process have exited.
+	 * Throws on failure.
+	 */
+	tap_stats tap(int fd, extract_sink const & sink, std::atomic<bool> const & stop, bool no_new_privs = false);
+
+	/// Detach from the process.
+	/**
+	 * Cached payloads are freed first.
+	 * Throws on failure.
+	 */
+	void detach();
+
+	/// Get the statistics of the payload cache.
+	cache_stats const & cache_statistics() const { return cache.stats(); }
+
+private:
+	int pid_;
+	bool attached_;
+	std::ostream * log_;
+	std::chrono::milliseconds timeout_;
+	bool fast_path_;
+
+	/// The last known stack region of the process.
+	dbpp::memory_region stack;
+
+	/// Payloads kept in memory of the process.
+	payload_cache cache;
+	traced_target traced;
+	std::unique_ptr<recorder> recorder_;
+	std::unique_ptr<recording_target> recording;
+	std::unique_ptr<colocation> colocation_;
+
+	/// Descriptors classified during this session.
+	std::map<int, fd_info> descriptors;
+
+	/// The target to make system calls in, which records them if recording is enabled.
+	target & remote();
+
+	/// Pin the calling thread close to the process and report the effect on the round trip latency.
+	void colocate();
+
+	/// Copy a payload to new memory of the process and add it to the payload cache.
+	/**
+	 * \return The address of the payload in the process.
+	 */
+	std::uintptr_t cache_payload(void const * data, std::size_t length);
+
+	/// Free the remote memory of payloads removed from the cache.
+	/**
+	 * All entries are freed before the first failure is reported.
+	 */
+	void release(std::vector<payload_cache::entry> const & entries);
+
+	/// Find stack memory of the process for a small payload.
+	/**
+	 * \return The start of the area, or 0 if the payload doesn't fit.
+	 */
+	std::uintptr_t stack_area(std::size_t length);
+
+	/// Get the deadline for an operation that starts now.
+	dbpp::deadline_t deadline() const;
+
+	/// Run an operation within the session timeout, detaching if it is exceeded.
+	template<typename F>
+	auto bounded(F && operation) -> decltype(operation());
+};
+
+}
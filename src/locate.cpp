@@ -0,0 +1,279 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+
+extern "C" {
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+}
+
+#include "locate.hpp"
+
+namespace fdinject {
+
+namespace {
+	std::system_error invalid_selector(std::string const & text, char const * reason) {
+		return std::system_error(std::make_error_code(std::errc::invalid_argument), "Invalid selector " + text + ": " + reason);
+	}
+
+	bool starts_with(std::string const & text, char const * prefix) {
+		return text.compare(0, std::strlen(prefix), prefix) == 0;
+	}
+
+	/// Parse an endpoint like 10.0.0.1:443 or [::1]:443.
+	endpoint parse_endpoint(std::string const & text, std::string const & selector) {
+		std::size_t colon = text.rfind(':');
+		if (colon == std::string::npos || colon + 1 == text.size()) throw invalid_selector(selector, "missing port");
+
+		std::string host = text.substr(0, colon);
+		if (host.size() >= 2 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
+
+		char * end;
+		unsigned long port = std::strtoul(text.c_str() + colon + 1, &end, 10);
+		if (*end || port > 65535) throw invalid_selector(selector, "invalid port");
+
+		endpoint result = {};
+		result.port = port;
+		in_addr v4;
+		if (inet_pton(AF_INET, host.c_str(), &v4) == 1) {
+			result.address[10] = 0xff;
+			result.address[11] = 0xff;
+			std::memcpy(&result.address[12], &v4, 4);
+		} else if (inet_pton(AF_INET6, host.c_str(), result.address.data()) != 1) {
+			throw invalid_selector(selector, "invalid address");
+		}
+		return result;
+	}
+
+	/// Parse an address from /proc/net/tcp or /proc/net/tcp6, like 0100007F:1F90.
+	/**
+	 * The address is printed as 32 bit words in host byte order.
+	 */
+	bool parse_proc_endpoint(std::string const & text, endpoint & result) {
+		std::size_t colon = text.find(':');
+		if (colon != 8 && colon != 32) return false;
+
+		result = {};
+		std::size_t words = colon / 8;
+		std::uint8_t * destination = words == 1 ? &result.address[12] : &result.address[0];
+		for (std::size_t i = 0; i < words; ++i) {
+			std::uint32_t word = std::strtoul(text.substr(i * 8, 8).c_str(), nullptr, 16);
+			std::memcpy(destination + i * 4, &word, 4);
+		}
+		if (words == 1) {
+			result.address[10] = 0xff;
+			result.address[11] = 0xff;
+		}
+		result.port = std::strtoul(text.c_str() + colon + 1, nullptr, 16);
+		return true;
+	}
+
+	bool operator== (endpoint const & a, endpoint const & b) {
+		return a.address == b.address && a.port == b.port;
+	}
+
+	/// Find the inodes of TCP sockets that match a selector.
+	void find_tcp_sockets(selector const & selector, std::unordered_set<std::string> & links) {
+		for (char const * path : {"/proc/net/tcp", "/proc/net/tcp6"}) {
+			std::ifstream file(path);
+			std::string line;
+			std::getline(file, line);
+			while (std::getline(file, line)) {
+				std::istringstream stream(line);
+				std::string slot, local, remote, state, queues, timer, retransmits, uid, timeout, inode;
+				if (!(stream >> slot >> local >> remote >> state >> queues >> timer >> retransmits >> uid >> timeout >> inode)) continue;
+
+				endpoint local_endpoint, remote_endpoint;
+				if (!parse_proc_endpoint(local, local_endpoint) || !parse_proc_endpoint(remote, remote_endpoint)) continue;
+				if (!(local_endpoint == selector.local)) continue;
+				if (selector.has_remote && !(remote_endpoint == selector.remote)) continue;
+				if (inode != "0") links.insert("socket:[" + inode + "]");
+			}
+		}
+	}
+
+	/// Find the inodes of unix sockets bound to a path.
+	void find_unix_sockets(std::string const & path, std::unordered_set<std::string> & links) {
+		std::ifstream file("/proc/net/unix");
+		std::string line;
+		std::getline(file, line);
+		while (std::getline(file, line)) {
+			std::istringstream stream(line);
+			std::string slot, references, protocol, flags, type, state, inode, socket_path;
+			if (!(stream >> slot >> references >> protocol >> flags >> type >> state >> inode >> socket_path)) continue;
+			if (socket_path == path) links.insert("socket:[" + inode + "]");
+		}
+	}
+
+	/// Get the link targets in /proc/<pid>/fd that match a selector.
+	std::unordered_set<std::string> resolve(selector const & selector) {
+		std::unordered_set<std::string> links;
+		switch (selector.type) {
+			case selector::kind::tcp:
+				find_tcp_sockets(selector, links);
+				break;
+			case selector::kind::inode:
+				links.insert("socket:[" + std::to_string(selector.inode) + "]");
+				links.insert("pipe:[" + std::to_string(selector.inode) + "]");
+				break;
+			case selector::kind::path: {
+				char real[PATH_MAX];
+				links.insert(realpath(selector.path.c_str(), real) ? real : selector.path);
+				find_unix_sockets(selector.path, links);
+				break;
+			}
+		}
+		return links;
+	}
+
+	std::string read_link(int directory, char const * name) {
+		char buffer[PATH_MAX];
+		ssize_t length = readlinkat(directory, name, buffer, sizeof(buffer));
+		if (length < 0) return "";
+		return std::string(buffer, length);
+	}
+
+	/// Get the process IDs of all processes, except this one.
+	std::vector<int> list_processes() {
+		std::vector<int> result;
+		long self = getpid();
+		DIR * proc = opendir("/proc");
+		if (!proc) throw std::system_error(errno, std::system_category(), "Failed to open /proc");
+		while (dirent * entry = readdir(proc)) {
+			char * end;
+			long pid = std::strtol(entry->d_name, &end, 10);
+			if (!*end && pid > 0 && pid != self) result.push_back(pid);
+		}
+		closedir(proc);
+		return result;
+	}
+
+	/// Scan the descriptors of a process for link targets.
+	void scan_process(int pid, std::unordered_set<std::string> const & links, std::vector<std::pair<fd_location, std::string>> & output) {
+		DIR * directory = opendir(("/proc/" + std::to_string(pid) + "/fd").c_str());
+		// The process exited or we are not allowed to look.
+		if (!directory) return;
+		while (dirent * entry = readdir(directory)) {
+			if (entry->d_name[0] == '.') continue;
+			std::string link = read_link(dirfd(directory), entry->d_name);
+			if (links.count(link)) output.emplace_back(fd_location{pid, std::atoi(entry->d_name)}, link);
+		}
+		closedir(directory);
+	}
+
+	/// Scan the descriptors of all processes for link targets, on multiple threads.
+	std::vector<std::pair<fd_location, std::string>> scan(std::unordered_set<std::string> const & links) {
+		std::vector<std::pair<fd_location, std::string>> result;
+		if (links.empty()) return result;
+
+		std::vector<int> processes = list_processes();
+		std::size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+		thread_count = std::min(thread_count, processes.size() / 16 + 1);
+
+		std::atomic<std::size_t> next{0};
+		std::mutex mutex;
+		auto work = [&] () {
+			std::vector<std::pair<fd_location, std::string>> found;
+			for (std::size_t i = next++; i < processes.size(); i = next++) scan_process(processes[i], links, found);
+			std::lock_guard<std::mutex> lock(mutex);
+			result.insert(result.end(), found.begin(), found.end());
+		};
+
+		std::vector<std::thread> threads;
+		for (std::size_t i = 1; i < thread_count; ++i) threads.emplace_back(work);
+		work();
+		for (auto & thread : threads) thread.join();
+
+		std::sort(result.begin(), result.end(), [] (std::pair<fd_location, std::string> const & a, std::pair<fd_location, std::string> const & b) {
+			return a.first.pid < b.first.pid || (a.first.pid == b.first.pid && a.first.fd < b.first.fd);
+		});
+		return result;
+	}
+}
+
+selector parse_selector(std::string const & text) {
+	selector result;
+	result.text = text;
+
+	if (starts_with(text, "tcp:")) {
+		result.type = selector::kind::tcp;
+		std::string endpoints = text.substr(4);
+		std::size_t arrow = endpoints.find("->");
+		result.local = parse_endpoint(endpoints.substr(0, arrow), text);
+		if (arrow != std::string::npos) {
+			result.has_remote = true;
+			result.remote     = parse_endpoint(endpoints.substr(arrow + 2), text);
+		}
+	} else if (starts_with(text, "inode:")) {
+		result.type = selector::kind::inode;
+		char * end;
+		result.inode = std::strtoull(text.c_str() + 6, &end, 10);
+		if (*end || end == text.c_str() + 6) throw invalid_selector(text, "invalid inode number");
+	} else if (starts_with(text, "path:") || starts_with(text, "/")) {
+		result.type = selector::kind::path;
+		result.path = starts_with(text, "path:") ? text.substr(5) : text;
+		if (result.path.empty()) throw invalid_selector(text, "empty path");
+	} else {
+		throw invalid_selector(text, "expected tcp:, inode:, path: or an absolute path");
+	}
+
+	return result;
+}
+
+std::vector<fd_location> locate(selector const & selector) {
+	std::vector<fd_location> result;
+	for (auto const & match : scan(resolve(selector))) result.push_back(match.first);
+	return result;
+}
+
+std::vector<fd_location> fd_locator::locate(selector const & selector) {
+	auto remembered = results.find(selector.text);
+	if (remembered != results.end()) {
+		bool valid = !remembered->second.locations.empty();
+		for (std::size_t i = 0; valid && i < remembered->second.locations.size(); ++i) {
+			fd_location const & location = remembered->second.locations[i];
+			std::string path = "/proc/" + std::to_string(location.pid) + "/fd";
+			valid = read_link(AT_FDCWD, (path + "/" + std::to_string(location.fd)).c_str()) == remembered->second.links[i];
+		}
+		if (valid) return remembered->second.locations;
+	}
+
+	result & entry = results[selector.text];
+	entry = result();
+	for (auto const & match : scan(resolve(selector))) {
+		entry.locations.push_back(match.first);
+		entry.links.push_back(match.second);
+	}
+	return entry.locations;
+}
+
+}
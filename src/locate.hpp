@@ -0,0 +1,121 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace fdinject {
+
+/// A file descriptor of a process.
+struct fd_location {
+	int pid;
+	int fd;
+};
+
+/// An IPv4 or IPv6 address with a port. IPv4 addresses are stored as IPv4-mapped IPv6 addresses.
+struct endpoint {
+	std::array<std::uint8_t, 16> address;
+	std::uint16_t port;
+};
+
+/// Describes the file descriptors to look for.
+struct selector {
+	enum class kind {
+		tcp,   ///< A TCP socket with a local and optionally a remote endpoint.
+		inode, ///< A socket or pipe with an inode number.
+		path,  ///< A file or a bound unix socket with a path.
+	};
+
+	kind type;
+
+	/// The local endpoint of a TCP socket.
+	endpoint local;
+
+	/// If true, the remote endpoint of a TCP socket must match as well.
+	bool has_remote = false;
+
+	/// The remote endpoint of a TCP socket.
+	endpoint remote;
+
+	/// The inode number of a socket or pipe.
+	std::uint64_t inode = 0;
+
+	/// The path of a file or unix socket.
+	std::string path;
+
+	/// The selector as given to parse_selector().
+	std::string text;
+};
+
+/// Parse a selector.
+/**
+ * Supported selectors:
+ *   tcp:LOCAL->REMOTE or tcp:LOCAL, where both endpoints are written as 10.0.0.1:443 or [::1]:443,
+ *   inode:NUMBER, for a socket or pipe,
+ *   path:PATH or an absolute path, for a file or a bound unix socket.
+ *
+ * Throws std::system_error with std::errc::invalid_argument if the selector is invalid.
+ */
+selector parse_selector(std::string const & text);
+
+/// Find the file descriptors of all processes that match a selector.
+/**
+ * TCP and unix sockets are resolved to inode numbers through /proc/net/tcp, /proc/net/tcp6 and /proc/net/unix,
+ * in the network namespace of the calling process.
+ * The descriptors in /proc/<pid>/fd of all other processes are then compared with the resolved inodes or paths,
+ * scanning processes on multiple threads.
+ *
+ * \return The matching descriptors, sorted by process ID and descriptor.
+ * Throws on failure.
+ */
+std::vector<fd_location> locate(selector const & selector);
+
+/// Locates file descriptors and remembers the results for repeated lookups.
+/**
+ * A remembered result is checked by reading the links of its descriptors again,
+ * and is only looked up from scratch when one of them changed or was closed.
+ * New descriptors that match a remembered selector are not found until refresh() is called.
+ */
+class fd_locator {
+public:
+	/// Find the file descriptors that match a selector, using a remembered result if it is still valid.
+	/**
+	 * Throws on failure.
+	 */
+	std::vector<fd_location> locate(selector const & selector);
+
+	/// Forget all remembered results.
+	void refresh() { results.clear(); }
+
+private:
+	struct result {
+		/// The link target of each location in /proc/<pid>/fd.
+		std::vector<std::string> links;
+		std::vector<fd_location> locations;
+	};
+
+	std::map<std::string, result> results;
+};
+
+}
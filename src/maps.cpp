@@ -0,0 +1,79 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+
+#include "maps.hpp"
+#include "exceptions.hpp"
+
+namespace dbpp {
+
+/// The permissions in the same format as /proc/<pid>/maps.
+std::string memory_region::permissions() const {
+	std::string result = "---p";
+	if (readable)   result[0] = 'r';
+	if (writable)   result[1] = 'w';
+	if (executable) result[2] = 'x';
+	if (shared)     result[3] = 's';
+	return result;
+}
+
+/// Read the memory map of a process.
+std::vector<memory_region> read_memory_map(int pid) {
+	std::ifstream file("/proc/" + std::to_string(pid) + "/maps");
+	if (!file) throw error(pid, {errno, std::system_category()}, "Failed to open memory map of process");
+
+	std::vector<memory_region> result;
+	std::string line;
+	while (std::getline(file, line)) {
+		// Format: start-end perms offset dev inode [name]
+		unsigned long long start, end, offset, inode;
+		char permissions[5];
+		int name_start = 0;
+		if (std::sscanf(line.c_str(), "%llx-%llx %4s %llx %*s %llu %n", &start, &end, permissions, &offset, &inode, &name_start) < 5) {
+			throw error(pid, std::make_error_code(std::errc::invalid_argument), "Failed to parse memory map of process: " + line);
+		}
+
+		memory_region region;
+		region.start      = start;
+		region.end        = end;
+		region.readable   = permissions[0] == 'r';
+		region.writable   = permissions[1] == 'w';
+		region.executable = permissions[2] == 'x';
+		region.shared     = permissions[3] == 's';
+		region.offset     = offset;
+		region.inode      = inode;
+		if (name_start > 0) region.name = line.substr(name_start);
+		result.push_back(std::move(region));
+	}
+
+	return result;
+}
+
+/// Find the region containing an address.
+memory_region const * find_region(std::vector<memory_region> const & regions, std::uintptr_t address) {
+	for (auto const & region : regions) {
+		if (region.contains(address)) return &region;
+	}
+	return nullptr;
+}
+
+}
@@ -0,0 +1,69 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dbpp {
+
+/// A mapped memory region of a process, as listed in /proc/<pid>/maps.
+struct memory_region {
+	std::uintptr_t start;
+	std::uintptr_t end;
+
+	bool readable;
+	bool writable;
+	bool executable;
+	bool shared;
+
+	/// Offset of the mapping in the mapped file.
+	std::uint64_t offset;
+
+	/// Inode of the mapped file, or 0 for anonymous mappings.
+	std::uint64_t inode;
+
+	/// Path of the mapped file or a pseudo name such as [heap] or [stack].
+	std::string name;
+
+	/// The size of the region in bytes.
+	std::size_t size() const { return end - start; }
+
+	/// Check if an address lies within the region.
+	bool contains(std::uintptr_t address) const { return address >= start && address < end; }
+
+	/// The permissions in the same format as /proc/<pid>/maps, for example "rw-p".
+	std::string permissions() const;
+};
+
+/// Read the memory map of a process.
+/**
+ * Throws on failure.
+ */
+std::vector<memory_region> read_memory_map(int pid);
+
+/// Find the region containing an address.
+/**
+ * \return A pointer to the region or nullptr if no region contains the address.
+ */
+memory_region const * find_region(std::vector<memory_region> const & regions, std::uintptr_t address);
+
+}
@@ -0,0 +1,111 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include "hash.hpp"
+#include "record.hpp"
+
+namespace fdinject {
+
+namespace {
+	/// Magic bytes at the start of a session log, including the format version.
+	char const magic[8] = {'F', 'D', 'I', 'L', 'O', 'G', '0', '1'};
+}
+
+/// Open a log file for writing.
+recorder::recorder(std::string const & path) : file(path, std::ios::binary | std::ios::trunc), epoch(clock::now()) {
+	if (!file) throw std::system_error(errno, std::system_category(), "Failed to open session log " + path);
+	file.write(magic, sizeof(magic));
+}
+
+/// Record an event without arguments.
+void recorder::event(record_type type, clock::time_point start, clock::time_point end, std::int64_t result) {
+	record record{};
+	record.type     = type;
+	record.time     = nanoseconds(start);
+	record.duration = nanoseconds(end) - record.time;
+	record.result   = result;
+	write(record);
+	file.flush();
+}
+
+/// Record the start of an injection.
+void recorder::inject(int fd, void const * data, std::size_t length, clock::time_point start) {
+	record record{};
+	record.type         = record_type::inject;
+	record.time         = nanoseconds(start);
+	record.number       = fd;
+	record.arguments[0] = length;
+	record.arguments[1] = hash64(data, length);
+	write(record);
+}
+
+/// Record a remote system call.
+void recorder::syscall(long number, std::array<dbpp::register_t, 6> const & arguments, long result, clock::time_point start, clock::time_point end) {
+	record record{};
+	record.type     = record_type::syscall;
+	record.time     = nanoseconds(start);
+	record.duration = nanoseconds(end) - record.time;
+	record.number   = number;
+	record.result   = result;
+	for (std::size_t i = 0; i < arguments.size(); ++i) record.arguments[i] = arguments[i];
+	write(record);
+}
+
+/// Record a memory copy.
+void recorder::copy(record_type type, std::uintptr_t address, std::size_t length, clock::time_point start, clock::time_point end) {
+	record record{};
+	record.type         = type;
+	record.time         = nanoseconds(start);
+	record.duration     = nanoseconds(end) - record.time;
+	record.arguments[0] = address;
+	record.arguments[1] = length;
+	write(record);
+}
+
+void recorder::write(record const & record) {
+	file.write(reinterpret_cast<char const *>(&record), sizeof(record));
+	if (!file) throw std::system_error(errno, std::system_category(), "Failed to write session log");
+}
+
+std::uint64_t recorder::nanoseconds(clock::time_point time) const {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(time - epoch).count();
+}
+
+/// Read all records from a session log.
+std::vector<record> read_log(std::string const & path) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file) throw std::system_error(errno, std::system_category(), "Failed to open session log " + path);
+
+	char header[sizeof(magic)];
+	if (!file.read(header, sizeof(header)) || std::memcmp(header, magic, sizeof(magic)) != 0) {
+		throw std::system_error(std::make_error_code(std::errc::invalid_argument), "Not a session log: " + path);
+	}
+
+	std::vector<record> result;
+	record record;
+	while (file.read(reinterpret_cast<char *>(&record), sizeof(record))) result.push_back(record);
+	if (file.gcount() != 0) throw std::system_error(std::make_error_code(std::errc::invalid_argument), "Truncated session log: " + path);
+	return result;
+}
+
+}
@@ -0,0 +1,104 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "dbpp.hpp"
+
+namespace fdinject {
+
+/// The type of a record in a session log.
+enum class record_type : std::uint32_t {
+	attach    = 1, ///< The process was attached and stopped.
+	detach    = 2, ///< The process was detached.
+	inject    = 3, ///< An injection started. Number is the fd, arguments[0] the length and arguments[1] the payload hash.
+	injected  = 4, ///< An injection finished. Result is 0 or a negative error number.
+	syscall   = 5, ///< A remote system call.
+	copy_to   = 6, ///< A copy to the process. Arguments[0] is the address and arguments[1] the length.
+	copy_from = 7, ///< A copy from the process. Arguments[0] is the address and arguments[1] the length.
+};
+
+/// A single record in a session log.
+/**
+ * Records are stored in native byte order.
+ */
+struct record {
+	record_type type;
+	std::uint32_t reserved;
+
+	/// Start of the event in nanoseconds since the start of the log.
+	std::uint64_t time;
+
+	/// Duration of the event in nanoseconds.
+	std::uint64_t duration;
+
+	/// System call number or file descriptor.
+	std::int64_t number;
+
+	std::array<std::uint64_t, 6> arguments;
+
+	/// Result of the event.
+	std::int64_t result;
+};
+
+/// Writes a compact binary log of injection sessions.
+class recorder {
+public:
+	using clock = std::chrono::steady_clock;
+
+	/// Open a log file for writing.
+	/**
+	 * Throws on failure.
+	 */
+	explicit recorder(std::string const & path);
+
+	/// Record an event without arguments.
+	void event(record_type type, clock::time_point start, clock::time_point end, std::int64_t result = 0);
+
+	/// Record the start of an injection.
+	void inject(int fd, void const * data, std::size_t length, clock::time_point start);
+
+	/// Record a remote system call.
+	void syscall(long number, std::array<dbpp::register_t, 6> const & arguments, long result, clock::time_point start, clock::time_point end);
+
+	/// Record a memory copy.
+	void copy(record_type type, std::uintptr_t address, std::size_t length, clock::time_point start, clock::time_point end);
+
+private:
+	std::ofstream file;
+	clock::time_point epoch;
+
+	void write(record const & record);
+	std::uint64_t nanoseconds(clock::time_point time) const;
+};
+
+/// Read all records from a session log.
+/**
+ * Throws on failure.
+ */
+std::vector<record> read_log(std::string const & path);
+
+}
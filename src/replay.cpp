@@ -0,0 +1,199 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+}
+
+#include "inject.hpp"
+#include "replay.hpp"
+
+namespace fdinject {
+
+namespace {
+	/// System call statistics of an injection.
+	struct injection_stats {
+		std::uint64_t duration = 0;
+		std::size_t syscalls   = 0;
+		std::size_t writes     = 0;
+		std::size_t again      = 0;
+	};
+
+	bool is_again(long result) {
+		return result == -EAGAIN || result == -EWOULDBLOCK;
+	}
+
+	/// A target that counts the system calls of another target.
+	class counting_target : public target {
+	public:
+		explicit counting_target(target & inner) : inner(inner) {}
+
+		int pid() const override { return inner.pid(); }
+
+		long syscall(long number, std::array<dbpp::register_t, 6> const & arguments) override {
+			long result = inner.syscall(number, arguments);
+			++stats.syscalls;
+			if (is_write_syscall(number)) ++stats.writes;
+			if (is_again(result)) ++stats.again;
+			return result;
+		}
+
+		void copy_to(std::uintptr_t destination, void const * source, std::size_t count) override {
+			inner.copy_to(destination, source, count);
+		}
+
+		void copy_from(void * destination, std::uintptr_t source, std::size_t count) override {
+			inner.copy_from(destination, source, count);
+		}
+
+		injection_stats stats;
+
+	private:
+		target & inner;
+	};
+
+	/// A pair of file descriptors connected to each other.
+	struct stand_in {
+		int reader = -1;
+		int writer = -1;
+
+		~stand_in() {
+			if (reader >= 0) close(reader);
+			if (writer >= 0) close(writer);
+		}
+	};
+
+	void check(int result, char const * what) {
+		if (result < 0) throw std::system_error(errno, std::system_category(), what);
+	}
+
+	void open_stand_in(stand_in & fds, replay_options const & options, bool non_blocking) {
+		int pair[2];
+		if (options.socket) {
+			check(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair), "Failed to create socket pair");
+		} else {
+			check(pipe2(pair, O_CLOEXEC), "Failed to create pipe");
+		}
+		fds.reader = pair[0];
+		fds.writer = pair[1];
+
+		if (options.buffer_size) {
+			int size = options.buffer_size;
+			if (options.socket) {
+				check(setsockopt(fds.writer, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)), "Failed to set socket buffer size");
+			} else {
+				check(fcntl(fds.writer, F_SETPIPE_SZ, size), "Failed to set pipe buffer size");
+			}
+		}
+
+		if (non_blocking) check(fcntl(fds.writer, F_SETFL, fcntl(fds.writer, F_GETFL) | O_NONBLOCK), "Failed to make stand-in descriptor non-blocking");
+	}
+
+	/// Read from a descriptor until end of file, limiting the rate.
+	void drain(int fd, std::size_t rate) {
+		using clock = std::chrono::steady_clock;
+		std::unique_ptr<char[]> buffer(new char[1 << 16]);
+		std::size_t total = 0;
+		auto start = clock::now();
+
+		while (true) {
+			std::size_t chunk = 1 << 16;
+			if (rate) chunk = std::max<std::size_t>(1, std::min<std::size_t>(chunk, rate / 100));
+			ssize_t result = read(fd, buffer.get(), chunk);
+			if (result < 0 && errno == EINTR) continue;
+			if (result <= 0) return;
+			total += result;
+
+			if (rate) {
+				auto due = start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(double(total) / rate));
+				std::this_thread::sleep_until(due);
+			}
+		}
+	}
+
+	void report(std::ostream & out, char const * name, injection_stats const & stats) {
+		out << "  " << name << ": " << stats.duration / 1e6 << " ms, "
+			<< stats.syscalls << " system calls, "
+			<< stats.writes << " writes, "
+			<< stats.again << " EAGAIN\n";
+	}
+}
+
+/// Replay the injections of a session log against a local stand-in target.
+void replay(std::vector<record> const & records, replay_options const & options, std::ostream & out) {
+	std::size_t injection = 0;
+	for (auto begin = records.begin(); begin != records.end(); ++begin) {
+		if (begin->type != record_type::inject) continue;
+
+		// Gather the recorded statistics.
+		injection_stats recorded;
+		auto end = begin + 1;
+		for (; end != records.end() && end->type != record_type::injected; ++end) {
+			if (end->type != record_type::syscall) continue;
+			++recorded.syscalls;
+			if (is_write_syscall(end->number)) ++recorded.writes;
+			if (is_again(end->result)) ++recorded.again;
+		}
+		if (end == records.end()) break;
+		recorded.duration = end->duration;
+
+		std::size_t length = begin->arguments[0];
+		out << "Injection " << ++injection << ": " << length << " bytes to descriptor " << begin->number;
+		if (end->result) out << " (failed with error " << -end->result << ")";
+		out << "\n";
+
+		// Replay with a synthesized payload of the same size.
+		std::vector<char> payload(length);
+		for (std::size_t i = 0; i < length; ++i) payload[i] = char(i);
+
+		stand_in fds;
+		open_stand_in(fds, options, recorded.again > 0);
+		std::thread drainer(drain, fds.reader, options.drain_rate);
+
+		local_target local;
+		counting_target counter(local);
+		auto start = recorder::clock::now();
+		try {
+			inject_data(counter, fds.writer, payload.data(), payload.size());
+		} catch (...) {
+			close(fds.writer);
+			fds.writer = -1;
+			drainer.join();
+			throw;
+		}
+		counter.stats.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(recorder::clock::now() - start).count();
+		close(fds.writer);
+		fds.writer = -1;
+		drainer.join();
+
+		report(out, "recorded", recorded);
+		report(out, "replayed", counter.stats);
+		begin = end;
+	}
+}
+
+}
@@ -0,0 +1,53 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+#include "record.hpp"
+
+namespace fdinject {
+
+/// Options for replaying a session log.
+struct replay_options {
+	/// The rate at which the stand-in reader drains data in bytes per second, or 0 for unlimited.
+	std::size_t drain_rate = 0;
+
+	/// Use a socket pair as stand-in descriptor instead of a pipe.
+	bool socket = false;
+
+	/// The size of the pipe or socket buffer in bytes, or 0 for the system default.
+	std::size_t buffer_size = 0;
+};
+
+/// Replay the injections of a session log against a local stand-in target.
+/**
+ * Every recorded injection is executed again by the current injection engine with a payload of the same size,
+ * writing to a local pipe or socket pair that is drained at a simulated rate.
+ * The stand-in descriptor is non-blocking if the recorded writes ran into EAGAIN.
+ * The recorded and replayed timing and system calls are reported to out.
+ *
+ * Throws on failure.
+ */
+void replay(std::vector<record> const & records, replay_options const & options, std::ostream & out);
+
+}
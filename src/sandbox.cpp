@@ -0,0 +1,245 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+extern "C" {
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+}
+
+#include "sandbox.hpp"
+
+namespace dbpp {
+
+/// Status of the last call, written by the server and its children.
+struct sandbox_server_base::header {
+	/// Set by the sandboxed child after the result has been stored.
+	volatile int completed;
+
+	/// The PID of the sandboxed child.
+	int pid;
+
+	/// The wait status of the sandboxed child, or -1 if the server failed to fork.
+	int status;
+
+	/// The errno value if the server failed to fork.
+	int error;
+};
+
+namespace {
+	std::size_t align(std::size_t value) {
+		std::size_t alignment = alignof(std::max_align_t);
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	/// Write a single byte to a socket, retrying on EINTR.
+	bool notify(int fd) {
+		char byte = 0;
+		while (true) {
+			ssize_t result = ::send(fd, &byte, 1, MSG_NOSIGNAL);
+			if (result == 1) return true;
+			if (result < 0 && errno == EINTR) continue;
+			return false;
+		}
+	}
+
+	/// Read a single byte from a socket, retrying on EINTR.
+	bool wait_notify(int fd) {
+		char byte;
+		while (true) {
+			ssize_t result = ::recv(fd, &byte, 1, 0);
+			if (result == 1) return true;
+			if (result < 0 && errno == EINTR) continue;
+			return false;
+		}
+	}
+
+	/// Wait for a socket to become readable, retrying on EINTR.
+	/**
+	 * Returns false if the deadline passed first.
+	 */
+	bool wait_readable(int fd, std::chrono::steady_clock::time_point deadline) {
+		while (true) {
+			auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+			if (remaining.count() < 0) remaining = std::chrono::milliseconds(0);
+
+			pollfd poll_fd = {fd, POLLIN, 0};
+			int result = ::poll(&poll_fd, 1, remaining.count() + 1);
+			if (result > 0) return true;
+			if (result < 0 && errno != EINTR) return true;
+			if (result == 0 && std::chrono::steady_clock::now() >= deadline) return false;
+		}
+	}
+}
+
+/// Create the shared mapping and fork the server.
+sandbox_server_base::sandbox_server_base(std::size_t request_size, std::size_t result_size, std::size_t scratch_size, void (*invoke)(void * request, void * result)) :
+	invoke(invoke),
+	timeout_(0)
+{
+	request_offset = align(sizeof(header));
+	result_offset  = request_offset + align(request_size);
+	scratch_offset = result_offset + align(result_size);
+	scratch_size_  = scratch_size;
+	mapping_size   = scratch_offset + scratch_size;
+
+	mapping = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED) throw error(-1, {errno, std::system_category()}, "Failed to create shared mapping for sandbox");
+
+	try {
+		start();
+	} catch (...) {
+		munmap(mapping, mapping_size);
+		throw;
+	}
+}
+
+/// Fork the server.
+void sandbox_server_base::start() {
+	// The socket pair is used to send requests and responses, without SIGPIPE if the other side dies.
+	int sockets[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0) {
+		int error = errno;
+		throw dbpp::error(-1, {error, std::system_category()}, "Failed to create socket pair for sandbox");
+	}
+
+	server_pid = ::fork();
+	if (server_pid == -1) {
+		int error = errno;
+		::close(sockets[0]);
+		::close(sockets[1]);
+		throw dbpp::error(-1, {error, std::system_category()}, "Failed to fork sandbox server");
+	}
+
+	// We're the server.
+	// Only use async-signal-safe functions here, the caller may have been multithreaded.
+	if (server_pid == 0) {
+		// Put the server and its children in their own process group, so they can be killed together.
+		setpgid(0, 0);
+		::close(sockets[0]);
+		header * shared = shared_header();
+		void * request  = static_cast<std::uint8_t *>(mapping) + request_offset;
+		void * result   = static_cast<std::uint8_t *>(mapping) + result_offset;
+
+		while (wait_notify(sockets[1])) {
+			shared->completed = 0;
+			shared->error     = 0;
+			int pid = ::fork();
+
+			// We're the sandboxed child.
+			if (pid == 0) {
+				invoke(request, result);
+				shared->completed = 1;
+				_exit(0);
+			}
+
+			shared->pid = pid;
+			if (pid == -1) {
+				shared->status = -1;
+				shared->error  = errno;
+			} else {
+				while (waitpid(pid, &shared->status, 0) == -1 && errno == EINTR);
+			}
+
+			if (!notify(sockets[1])) break;
+		}
+		_exit(0);
+	}
+
+	// We're the parent.
+	setpgid(server_pid, server_pid);
+	::close(sockets[1]);
+	socket = sockets[0];
+}
+
+/// Kill the server and everything it forked, and wait for the server to exit.
+void sandbox_server_base::stop() {
+	::kill(-server_pid, SIGKILL);
+	::kill(server_pid, SIGKILL);
+	::close(socket);
+	while (waitpid(server_pid, nullptr, 0) == -1 && errno == EINTR);
+	server_pid = -1;
+	socket     = -1;
+}
+
+/// Stop the server process and release the shared mapping.
+sandbox_server_base::~sandbox_server_base() {
+	// The server may be gone if it failed to restart after a timeout.
+	if (server_pid == -1) {
+		munmap(mapping, mapping_size);
+		return;
+	}
+
+	// Shutting down the socket makes the server exit.
+	// Closing it is not enough, since other servers and sandboxed children may have inherited a copy.
+	shutdown(socket, SHUT_RDWR);
+	::close(socket);
+	while (waitpid(server_pid, nullptr, 0) == -1 && errno == EINTR);
+	munmap(mapping, mapping_size);
+}
+
+void * sandbox_server_base::request() const {
+	return static_cast<std::uint8_t *>(mapping) + request_offset;
+}
+
+void * sandbox_server_base::result() const {
+	return static_cast<std::uint8_t *>(mapping) + result_offset;
+}
+
+void * sandbox_server_base::scratch() const {
+	return static_cast<std::uint8_t *>(mapping) + scratch_offset;
+}
+
+sandbox_server_base::header * sandbox_server_base::shared_header() const {
+	return static_cast<header *>(mapping);
+}
+
+/// Execute the request in a fresh child of the server and wait for it to finish.
+void sandbox_server_base::call() {
+	if (!notify(socket)) throw error(server_pid, {errno, std::system_category()}, "Failed to send request to sandbox server");
+
+	// A call that doesn't finish in time may be stuck anywhere, so replace the whole server.
+	if (timeout_.count() > 0 && !wait_readable(socket, std::chrono::steady_clock::now() + timeout_)) {
+		int pid = server_pid;
+		stop();
+		start();
+		throw deadline_exceeded(pid, "Sandboxed call did not finish before the deadline");
+	}
+
+	if (!wait_notify(socket)) throw process_terminated(server_pid, false, 0, "Sandbox server terminated");
+
+	header * shared = shared_header();
+	if (shared->status == -1) throw error(server_pid, {shared->error, std::system_category()}, "Sandbox server failed to fork");
+	if (shared->completed) return;
+
+	int status = shared->status;
+	if (WIFSIGNALED(status)) throw process_terminated(shared->pid, false, WTERMSIG(status), "Sandboxed call was killed by a signal");
+	throw process_terminated(shared->pid, true, WEXITSTATUS(status), "Sandboxed call exited without returning");
+}
+
+}
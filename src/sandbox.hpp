@@ -0,0 +1,248 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "exceptions.hpp"
+
+namespace dbpp {
+
+namespace detail {
+	template<std::size_t... I> struct index_sequence {};
+	template<std::size_t N, std::size_t... I> struct make_index_sequence : make_index_sequence<N - 1, N - 1, I...> {};
+	template<std::size_t... I> struct make_index_sequence<0, I...> { using type = index_sequence<I...>; };
+
+	template<bool... B> struct bool_pack {};
+	template<bool... B> using all_true = std::is_same<bool_pack<true, B...>, bool_pack<B..., true>>;
+
+	/// Storage for the result of a function, specialized for void.
+	/**
+	 * The result is constructed in raw storage, so it doesn't need to be default constructible.
+	 */
+	template<typename R> struct result_storage {
+		typename std::aligned_storage<sizeof(R), alignof(R)>::type value;
+
+		template<typename F, typename T, std::size_t... I>
+		void invoke(F f, T & arguments, index_sequence<I...>) { new (&value) R(f(std::get<I>(arguments)...)); }
+
+		R get() const { return *reinterpret_cast<R const *>(&value); }
+	};
+
+	template<> struct result_storage<void> {
+		template<typename F, typename T, std::size_t... I>
+		void invoke(F f, T & arguments, index_sequence<I...>) { f(std::get<I>(arguments)...); }
+
+		void get() const {}
+	};
+}
+
+/// Type erased part of a sandbox server.
+/**
+ * The server is a child process forked when the sandbox_server is created.
+ * For every call, the server forks a fresh child that executes the function and exits.
+ * Arguments, the result and a scratch area for out-buffers are passed through a shared anonymous mapping,
+ * so no tracing is needed to get the result back to the caller.
+ *
+ * With a timeout, a call that takes too long is killed together with the server, and a new server is started.
+ */
+class sandbox_server_base {
+public:
+	sandbox_server_base(sandbox_server_base const &) = delete;
+	sandbox_server_base & operator= (sandbox_server_base const &) = delete;
+
+	/// Stop the server process and release the shared mapping.
+	~sandbox_server_base();
+
+	/// The process ID of the server.
+	int pid() const { return server_pid; }
+
+	/// A memory area shared with the sandboxed function, for passing out-buffers back to the caller.
+	void * scratch() const;
+
+	/// The size of the scratch area.
+	std::size_t scratch_size() const { return scratch_size_; }
+
+	/// Limit the duration of calls, or remove the limit with a timeout of zero.
+	void set_timeout(std::chrono::milliseconds timeout) { timeout_ = timeout; }
+
+protected:
+	/// Create the shared mapping and fork the server.
+	/**
+	 * Throws on failure.
+	 */
+	sandbox_server_base(std::size_t request_size, std::size_t result_size, std::size_t scratch_size, void (*invoke)(void * request, void * result));
+
+	/// The shared area holding the request.
+	void * request() const;
+
+	/// The shared area holding the result.
+	void * result() const;
+
+	/// Execute the request in a fresh child of the server and wait for it to finish.
+	/**
+	 * Throws process_terminated if the child did not return normally from the function.
+	 * Throws deadline_exceeded if the call did not finish within the timeout.
+	 * The server is restarted in that case, so the next call works again.
+	 */
+	void call();
+
+private:
+	struct header;
+
+	void (*invoke)(void * request, void * result);
+	std::chrono::milliseconds timeout_;
+	int server_pid;
+	int socket;
+	void * mapping;
+	std::size_t mapping_size;
+	std::size_t request_offset;
+	std::size_t result_offset;
+	std::size_t scratch_offset;
+	std::size_t scratch_size_;
+
+	header * shared_header() const;
+
+	/// Fork the server.
+	/**
+	 * Throws on failure.
+	 */
+	void start();
+
+	/// Kill the server and everything it forked, and wait for the server to exit.
+	void stop();
+};
+
+/// A fork server for calling a function in a sandbox.
+/**
+ * Compared to call_sandboxed, every call costs one fork of the small server process
+ * and one round trip over a socket, instead of forking the caller and trapping twice.
+ *
+ * Arguments and the result must be trivially copyable. The result does not need to be default constructible.
+ * Pointers passed as arguments refer to the memory of the server, which is a copy of the caller at the time the server was created.
+ * Use scratch() to pass out-buffers back to the caller.
+ */
+template<typename R, typename... A>
+class sandbox_server : public sandbox_server_base {
+	using function_t  = R (*) (A...);
+	using arguments_t = std::tuple<typename std::decay<A>::type...>;
+
+	struct request_t {
+		function_t function;
+		arguments_t arguments;
+	};
+
+	static_assert(detail::all_true<std::is_trivially_copyable<typename std::decay<A>::type>::value...>::value, "Sandboxed function arguments must be trivially copyable.");
+	static_assert(std::is_void<R>::value || std::is_trivially_copyable<R>::value, "Sandboxed function results must be trivially copyable.");
+
+	static void invoke(void * request, void * result) {
+		request_t & r = *static_cast<request_t *>(request);
+		static_cast<detail::result_storage<R> *>(result)->invoke(r.function, r.arguments, typename detail::make_index_sequence<sizeof...(A)>::type());
+	}
+
+public:
+	/// Create a fork server for a function.
+	/**
+	 * Throws on failure.
+	 */
+	explicit sandbox_server(function_t function, std::size_t scratch_size = 0) :
+		sandbox_server_base(sizeof(request_t), sizeof(detail::result_storage<R>), scratch_size, &invoke),
+		function(function) {}
+
+	/// Call the function in a fresh sandbox and return the result.
+	/**
+	 * Throws process_terminated if the sandboxed call did not return normally.
+	 * Throws deadline_exceeded if the call did not finish within the timeout.
+	 */
+	template<typename... B>
+	R operator() (B && ...args) {
+		new (request()) request_t{function, arguments_t(std::forward<B>(args)...)};
+		sandbox_server_base::call();
+		return static_cast<detail::result_storage<R> *>(result())->get();
+	}
+
+private:
+	function_t function;
+};
+
+/// A pool of warm sandbox servers, so multiple threads can make sandboxed calls concurrently.
+template<typename R, typename... A>
+class sandbox_pool {
+public:
+	/// Create a pool with a number of servers.
+	/**
+	 * A non-zero timeout limits the duration of each call, see sandbox_server_base::set_timeout().
+	 * Throws on failure.
+	 */
+	sandbox_pool(R (*function) (A...), std::size_t size, std::size_t scratch_size = 0, std::chrono::milliseconds timeout = std::chrono::milliseconds(0)) {
+		for (std::size_t i = 0; i < size; ++i) {
+			servers.emplace_back(new sandbox_server<R, A...>(function, scratch_size));
+			servers.back()->set_timeout(timeout);
+			idle.push_back(servers.back().get());
+		}
+	}
+
+	/// Call the function on the first idle server.
+	/**
+	 * Blocks until a server is available.
+	 * Throws process_terminated if the sandboxed call did not return normally.
+	 * Throws deadline_exceeded if the call did not finish within the timeout.
+	 */
+	template<typename... B>
+	R operator() (B && ...args) {
+		lease lease(*this);
+		return (*lease.server)(std::forward<B>(args)...);
+	}
+
+private:
+	struct lease {
+		sandbox_pool & pool;
+		sandbox_server<R, A...> * server;
+
+		explicit lease(sandbox_pool & pool) : pool(pool) {
+			std::unique_lock<std::mutex> lock(pool.mutex);
+			pool.available.wait(lock, [&] () { return !pool.idle.empty(); });
+			server = pool.idle.back();
+			pool.idle.pop_back();
+		}
+
+		~lease() {
+			std::lock_guard<std::mutex> lock(pool.mutex);
+			pool.idle.push_back(server);
+			pool.available.notify_one();
+		}
+	};
+
+	std::vector<std::unique_ptr<sandbox_server<R, A...>>> servers;
+	std::vector<sandbox_server<R, A...> *> idle;
+	std::mutex mutex;
+	std::condition_variable available;
+};
+
+}
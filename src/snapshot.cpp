@@ -0,0 +1,181 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+extern "C" {
+#include <unistd.h>
+}
+
+#include "dbpp.hpp"
+#include "snapshot.hpp"
+
+namespace dbpp {
+
+namespace {
+	/// A part of a region that is read by a single worker.
+	struct chunk {
+		std::uintptr_t address;
+		std::size_t length;
+		std::uint64_t file_offset;
+		std::size_t region;
+	};
+
+	std::size_t page_size() {
+		static std::size_t const result = sysconf(_SC_PAGESIZE);
+		return result;
+	}
+
+	bool is_zero(std::uint8_t const * data, std::size_t length) {
+		return data[0] == 0 && std::memcmp(data, data + 1, length - 1) == 0;
+	}
+
+	/// Write the non-zero pages of a buffer to a file.
+	/**
+	 * \return The number of zero bytes that were skipped.
+	 */
+	std::size_t write_sparse(int pid, int fd, std::uint8_t const * data, std::size_t length, std::uint64_t offset) {
+		std::size_t skipped = 0;
+		std::size_t page    = page_size();
+
+		std::size_t i = 0;
+		while (i < length) {
+			// Skip zero pages.
+			std::size_t size = std::min(page, length - i);
+			if (is_zero(data + i, size)) {
+				skipped += size;
+				i       += size;
+				continue;
+			}
+
+			// Find the end of the non-zero run and write it in one go.
+			std::size_t end = i + size;
+			while (end < length && !is_zero(data + end, std::min(page, length - end))) end += std::min(page, length - end);
+
+			while (i < end) {
+				ssize_t written = pwrite(fd, data + i, end - i, offset + i);
+				if (written < 0) throw error(pid, {errno, std::system_category()}, "Failed to write snapshot");
+				i += written;
+			}
+		}
+
+		return skipped;
+	}
+}
+
+/// Copy memory regions of a process to a file.
+snapshot_stats snapshot(int pid, std::vector<memory_region> const & regions, int output_fd, std::vector<snapshot_region> & index, snapshot_options const & options) {
+	std::size_t page       = page_size();
+	std::size_t chunk_size = std::max(page, options.chunk_size / page * page);
+
+	// Lay out the regions in the file and cut them in chunks.
+	snapshot_stats stats;
+	std::vector<chunk> chunks;
+	std::size_t first_region = index.size();
+	for (auto const & region : regions) {
+		index.push_back({region, stats.file_size, 0});
+		for (std::uintptr_t address = region.start; address < region.end; address += chunk_size) {
+			std::size_t length = std::min<std::uintptr_t>(chunk_size, region.end - address);
+			chunks.push_back({address, length, stats.file_size + (address - region.start), index.size() - 1});
+		}
+		stats.file_size += (region.size() + page - 1) / page * page;
+	}
+
+	if (ftruncate(output_fd, stats.file_size) != 0) throw error(pid, {errno, std::system_category()}, "Failed to resize snapshot");
+
+	std::atomic<std::size_t> next_chunk{0};
+	std::mutex mutex;
+	std::exception_ptr exception;
+
+	auto worker = [&] () {
+		std::unique_ptr<std::uint8_t[]> buffer(new std::uint8_t[chunk_size]);
+		std::size_t read       = 0;
+		std::size_t unreadable = 0;
+		std::size_t zero       = 0;
+		std::vector<std::pair<std::size_t, std::size_t>> region_unreadable;
+
+		try {
+			while (true) {
+				std::size_t i = next_chunk++;
+				if (i >= chunks.size()) break;
+				chunk const & chunk = chunks[i];
+
+				std::size_t position = 0;
+				while (position < chunk.length) {
+					std::size_t count = read_memory_bulk(pid, buffer.get() + position, chunk.address + position, chunk.length - position);
+
+					// Skip the unreadable page, such as a guard page, and continue reading right after it.
+					if (count == 0) {
+						std::size_t skip = std::min(page - (chunk.address + position) % page, chunk.length - position);
+						region_unreadable.emplace_back(chunk.region, skip);
+						unreadable += skip;
+						position   += skip;
+						continue;
+					}
+
+					zero     += write_sparse(pid, output_fd, buffer.get() + position, count, chunk.file_offset + position);
+					read     += count;
+					position += count;
+				}
+			}
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!exception) exception = std::current_exception();
+			next_chunk = chunks.size();
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.bytes_read       += read;
+		stats.bytes_unreadable += unreadable;
+		stats.bytes_zero       += zero;
+		for (auto const & entry : region_unreadable) index[entry.first].unreadable += entry.second;
+	};
+
+	unsigned int thread_count = std::max(1u, std::min<unsigned int>(options.threads, chunks.size()));
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < thread_count; ++i) threads.emplace_back(worker);
+	worker();
+	for (auto & thread : threads) thread.join();
+
+	if (exception) {
+		index.resize(first_region);
+		std::rethrow_exception(exception);
+	}
+
+	return stats;
+}
+
+/// Write a snapshot index in text form.
+void write_snapshot_index(std::ostream & stream, std::vector<snapshot_region> const & index) {
+	std::ios::fmtflags flags = stream.flags();
+	for (auto const & entry : index) {
+		stream << std::hex << entry.region.start << '-' << entry.region.end << ' ' << entry.region.permissions();
+		stream << ' ' << std::dec << entry.file_offset << ' ' << entry.unreadable << ' ' << entry.region.name << '\n';
+	}
+	stream.flags(flags);
+}
+
+}
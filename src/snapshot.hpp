@@ -0,0 +1,86 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "maps.hpp"
+
+namespace dbpp {
+
+/// Options for taking a memory snapshot.
+struct snapshot_options {
+	/// The number of worker threads reading memory.
+	unsigned int threads = 4;
+
+	/// The number of bytes a worker reads with one system call.
+	std::size_t chunk_size = 4 << 20;
+};
+
+/// A region stored in a snapshot.
+struct snapshot_region {
+	/// The memory region in the process.
+	memory_region region;
+
+	/// The offset of the region in the snapshot file.
+	std::uint64_t file_offset;
+
+	/// The number of bytes that could not be read and are left as a hole in the snapshot file.
+	std::size_t unreadable;
+};
+
+/// Statistics of a snapshot.
+struct snapshot_stats {
+	/// The number of bytes read from the process.
+	std::size_t bytes_read = 0;
+
+	/// The number of bytes that could not be read.
+	std::size_t bytes_unreadable = 0;
+
+	/// The number of bytes that were read but not written because they were zero.
+	std::size_t bytes_zero = 0;
+
+	/// The total size of the snapshot file, including holes.
+	std::uint64_t file_size = 0;
+};
+
+/// Copy memory regions of a process to a file.
+/**
+ * Regions are stored one after another at page aligned offsets.
+ * Unreadable and zero pages are not written, so they become holes in a sparse file.
+ * The location of each region is added to index.
+ *
+ * The regions are read in chunks by a pool of worker threads using process_vm_readv.
+ * Pages that can not be read are skipped one at a time, so readable pages after them are still copied.
+ *
+ * Throws on failure.
+ */
+snapshot_stats snapshot(int pid, std::vector<memory_region> const & regions, int output_fd, std::vector<snapshot_region> & index, snapshot_options const & options = snapshot_options());
+
+/// Write a snapshot index in text form.
+/**
+ * Each line has the format: start-end perms file_offset unreadable name
+ */
+void write_snapshot_index(std::ostream & stream, std::vector<snapshot_region> const & index);
+
+}
@@ -0,0 +1,218 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+
+extern "C" {
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+}
+
+#include "inject.hpp"
+#include "splice.hpp"
+
+namespace fdinject {
+
+/// Get the name of a splice strategy.
+char const * to_string(splice_strategy strategy) {
+	switch (strategy) {
+		case splice_strategy::copy_file_range: return "copy_file_range";
+		case splice_strategy::splice:          return "splice";
+		case splice_strategy::sendfile:        return "sendfile";
+		case splice_strategy::pipe:            return "splice through a temporary pipe";
+	}
+	return "unknown";
+}
+
+namespace {
+	/// The maximum number of bytes moved by a single system call.
+	constexpr std::uint64_t chunk_size = 1 << 20;
+
+	bool would_block(long result) {
+		return result == -EAGAIN || result == -EWOULDBLOCK;
+	}
+
+	void check(target & target, long result, char const * what) {
+		if (result < 0) throw dbpp::error(target.pid(), {int(-result), std::generic_category()}, what);
+	}
+
+	splice_strategy choose(fd_info const & in, fd_info const & out) {
+		if (in.type == fd_type::regular && out.type == fd_type::regular) return splice_strategy::copy_file_range;
+		if (in.type == fd_type::pipe || out.type == fd_type::pipe)       return splice_strategy::splice;
+		if (in.type == fd_type::regular)                                   return splice_strategy::sendfile;
+		return splice_strategy::pipe;
+	}
+
+	long splice(target & target, int in_fd, int out_fd, std::uint64_t length) {
+		return target.syscall(275, {{unsigned(in_fd), 0, unsigned(out_fd), 0, length, SPLICE_F_MOVE}});
+	}
+
+	/// Wait in the target until the output is writable, or until a timeout.
+	void wait_writable(target & target, int out_fd, std::uintptr_t scratch) {
+		pollfd fd = {out_fd, POLLOUT, 0};
+		target.copy_to(scratch, &fd, sizeof(fd));
+		check(target, target.syscall(7, {{scratch, 1, 1000, 0, 0, 0}}), "Failed to execute poll system call in traced process");
+	}
+
+	/// Wait in the target until the input is readable and the output is writable, or until a timeout.
+	/**
+	 * The input is waited for first, because a writable output would end a combined poll right away.
+	 * \return False if the input has no data available, in which case moving data stops.
+	 */
+	bool wait_ready(target & target, int in_fd, int out_fd, std::uintptr_t scratch) {
+		pollfd fd = {in_fd, POLLIN, 0};
+		target.copy_to(scratch, &fd, sizeof(fd));
+		check(target, target.syscall(7, {{scratch, 1, 1000, 0, 0, 0}}), "Failed to execute poll system call in traced process");
+		target.copy_from(&fd, scratch, sizeof(fd));
+		if (!(fd.revents & (POLLIN | POLLHUP))) return false;
+		wait_writable(target, out_fd, scratch);
+		return true;
+	}
+
+	/// Move data through a temporary pipe in the target.
+	std::uint64_t splice_through_pipe(target & target, int in_fd, int out_fd, std::uint64_t length, bool may_block, std::uintptr_t scratch) {
+		check(target, target.syscall(293, {{scratch, O_CLOEXEC | O_NONBLOCK, 0, 0, 0, 0}}), "Failed to execute pipe2 system call in traced process");
+		int pipe[2];
+		target.copy_from(pipe, scratch, sizeof(pipe));
+
+		// A larger pipe means fewer round trips. Failure is not a problem.
+		target.syscall(72, {{unsigned(pipe[1]), F_SETPIPE_SZ, chunk_size, 0, 0, 0}});
+
+		std::uint64_t moved = 0;
+		try {
+			while (!length || moved < length) {
+				std::uint64_t wanted = length ? std::min(chunk_size, length - moved) : chunk_size;
+				if (may_block && !wait_ready(target, in_fd, pipe[1], scratch)) break;
+				long received = splice(target, in_fd, pipe[1], wanted);
+				if (would_block(received)) {
+					if (!wait_ready(target, in_fd, pipe[1], scratch)) break;
+					continue;
+				}
+				check(target, received, "Failed to execute splice system call in traced process");
+				if (received == 0) break;
+
+				// Drain the pipe completely, so no data is left behind.
+				long pending = received;
+				while (pending > 0) {
+					long sent = splice(target, pipe[0], out_fd, pending);
+					if (would_block(sent)) {
+						wait_writable(target, out_fd, scratch);
+						continue;
+					}
+					check(target, sent, "Failed to execute splice system call in traced process");
+					pending -= sent;
+					moved   += sent;
+				}
+			}
+		} catch (...) {
+			target.syscall(3, {{unsigned(pipe[0]), 0, 0, 0, 0, 0}});
+			target.syscall(3, {{unsigned(pipe[1]), 0, 0, 0, 0, 0}});
+			throw;
+		}
+
+		target.syscall(3, {{unsigned(pipe[0]), 0, 0, 0, 0, 0}});
+		target.syscall(3, {{unsigned(pipe[1]), 0, 0, 0, 0, 0}});
+		return moved;
+	}
+
+	/// Move data directly from one descriptor to the other.
+	std::uint64_t splice_direct(target & target, splice_strategy strategy, int in_fd, int out_fd, std::uint64_t length, bool may_block, std::uintptr_t scratch) {
+		std::uint64_t moved = 0;
+		while (!length || moved < length) {
+			std::uint64_t wanted = length ? std::min(chunk_size, length - moved) : chunk_size;
+			if (may_block && !wait_ready(target, in_fd, out_fd, scratch)) break;
+			long result;
+			switch (strategy) {
+				case splice_strategy::copy_file_range:
+					result = target.syscall(326, {{unsigned(in_fd), 0, unsigned(out_fd), 0, wanted, 0}});
+					break;
+				case splice_strategy::sendfile:
+					result = target.syscall(40, {{unsigned(out_fd), unsigned(in_fd), 0, wanted, 0, 0}});
+					break;
+				default:
+					result = splice(target, in_fd, out_fd, wanted);
+					break;
+			}
+
+			if (would_block(result)) {
+				if (!wait_ready(target, in_fd, out_fd, scratch)) break;
+				continue;
+			}
+
+			// Older kernels don't support copy_file_range across file systems.
+			if (strategy == splice_strategy::copy_file_range && moved == 0 && (result == -EXDEV || result == -EINVAL || result == -EOPNOTSUPP || result == -ENOSYS)) {
+				strategy = splice_strategy::sendfile;
+				continue;
+			}
+			check(target, result, "Failed to move data in traced process");
+			if (result == 0) break;
+			moved += result;
+		}
+		return moved;
+	}
+}
+
+/// Move data between two file descriptors of a target without copying it to user space.
+std::uint64_t splice_data(target & target, int in_fd, int out_fd, std::uint64_t length, std::ostream * log) {
+	int pid = target.pid();
+
+	long scratch = mmap(target, 0, fd_scratch_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, 0, 0);
+	if (scratch < 0) throw dbpp::error(pid, {int(-scratch), std::generic_category()}, "Failed to allocate memory in process");
+
+	std::uint64_t moved = 0;
+	try {
+		fd_info in  = classify(target, in_fd,  scratch);
+		fd_info out = classify(target, out_fd, scratch);
+		splice_strategy strategy = choose(in, out);
+		if (log) {
+			*log << "Input " << in_fd << " is a " << to_string(in.type) << " (" << in.path << "), ";
+			*log << "output " << out_fd << " is a " << to_string(out.type) << " (" << out.path << ").\n";
+			*log << "Using " << to_string(strategy) << ".\n";
+		}
+
+		// Never leave the target blocked on an idle input: a blocking input is polled before every move.
+		bool may_block = in.type != fd_type::regular && !(in.flags & O_NONBLOCK);
+
+		auto start = std::chrono::steady_clock::now();
+		if (strategy == splice_strategy::pipe) {
+			moved = splice_through_pipe(target, in_fd, out_fd, length, may_block, scratch);
+		} else {
+			moved = splice_direct(target, strategy, in_fd, out_fd, length, may_block, scratch);
+		}
+
+		if (log) {
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			*log << "Moved " << moved << " bytes in " << seconds * 1e3 << " ms";
+			if (seconds > 0) *log << " (" << moved / seconds / (1 << 20) << " MiB/s)";
+			*log << ".\n";
+		}
+	} catch (...) {
+		munmap(target, scratch, fd_scratch_size);
+		throw;
+	}
+
+	int result = munmap(target, scratch, fd_scratch_size);
+	if (result < 0) throw dbpp::error(pid, {int(-result), std::generic_category()}, "Failed to deallocate memory in process");
+	return moved;
+}
+
+}
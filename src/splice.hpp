@@ -0,0 +1,57 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+#include "fdinfo.hpp"
+#include "target.hpp"
+
+namespace fdinject {
+
+/// The primitive used to move data between two descriptors of a target.
+enum class splice_strategy {
+	copy_file_range, ///< copy_file_range() between two regular files.
+	splice,          ///< splice() directly, when one of the descriptors is a pipe.
+	sendfile,        ///< sendfile() from a regular file.
+	pipe,            ///< splice() through a temporary pipe in the target.
+};
+
+/// Get the name of a splice strategy.
+char const * to_string(splice_strategy strategy);
+
+/// Move data between two file descriptors of a target without copying it to user space.
+/**
+ * The target runs copy_file_range(), splice() or sendfile() in a loop,
+ * going through a temporary pipe if neither descriptor is a pipe or a regular file.
+ * Both descriptors use and advance their own file offsets.
+ *
+ * Data is moved until length bytes were moved, the input reaches end of file,
+ * or the input has no data available for a second. A length of 0 means no limit.
+ * Blocking inputs other than regular files are polled before every move, so the target never blocks on an idle input.
+ * Progress and throughput are reported to log, if it is not null.
+ *
+ * \return The number of bytes moved.
+ * Throws on failure.
+ */
+std::uint64_t splice_data(target & target, int in_fd, int out_fd, std::uint64_t length, std::ostream * log = nullptr);
+
+}
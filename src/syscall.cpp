@@ -20,8 +20,31 @@
 
 namespace dbpp {
 
+namespace {
+	/// Interrupt an injected system call that missed its deadline and wait until the client stopped outside it.
+	/**
+	 * A blocking system call is aborted by the interrupt and reports its exit first.
+	 * If the client did not enter the system call yet, it is skipped by invalidating the system call number.
+	 *
+	 * This waits without deadline: a call in uninterruptible sleep only stops once it completes,
+	 * and the injected code and registers can only be restored after that.
+	 */
+	void abort_syscall(int pid, bool entered) {
+		interrupt(pid);
+		while (true) {
+			if (!wait_for_syscall(pid)) return;
+			if (entered) return;
+			registers_t registers = get_registers(pid);
+			registers.orig_ax = register_t(-1);
+			set_registers(pid, registers);
+			entered = true;
+			step_syscall(pid);
+		}
+	}
+}
+
 /// Make the client perform a syscall with the given number and parameters.
-register_t syscall(int pid, register_t syscall, std::array<register_t, 6> const & parameters) {
+register_t syscall(int pid, register_t syscall, std::array<register_t, 6> const & parameters, deadline_t deadline) {
 	registers_t old_registers = get_registers(pid);
 	registers_t new_registers = old_registers;
 	unsigned long old_code = read_memory(pid, old_registers.ip);
@@ -52,10 +75,28 @@ register_t syscall(int pid, register_t syscall, std::array<register_t, 6> const
 #endif
 
 	// Wait for entry and exit.
-	step_syscall(pid);
-	while (!wait_for_syscall(pid));
-	step_syscall(pid);
-	while (!wait_for_syscall(pid));
+	bool entered = false;
+	try {
+		step_syscall(pid);
+		while (!wait_for_syscall(pid, deadline));
+		entered = true;
+		step_syscall(pid);
+		while (!wait_for_syscall(pid, deadline));
+	} catch (deadline_exceeded const &) {
+		// Never leave the patched code or the injected registers behind, even if aborting fails.
+		try {
+			abort_syscall(pid, entered);
+		} catch (...) {
+			try {
+				write_memory(pid, old_registers.ip, old_code);
+				set_registers(pid, old_registers);
+			} catch (...) {}
+			throw;
+		}
+		write_memory(pid, old_registers.ip, old_code);
+		set_registers(pid, old_registers);
+		throw;
+	}
 
 	new_registers = get_registers(pid);
 
@@ -23,6 +23,13 @@
 namespace dbpp {
 
 /// Make the client perform a syscall with the given number and parameters.
-register_t syscall(int pid, register_t syscall, std::array<register_t, 6> const & parameters);
+/**
+ * If the system call did not complete before the deadline, it is interrupted,
+ * the original code and registers of the client are restored and deadline_exceeded is thrown.
+ * A call in uninterruptible sleep can not be interrupted, so restoring the client waits until it completes.
+ * The client is left stopped, but may have a pending ptrace interrupt,
+ * so the caller should detach from the client rather than keep using it.
+ */
+register_t syscall(int pid, register_t syscall, std::array<register_t, 6> const & parameters, deadline_t deadline = deadline_t::max());
 
 }
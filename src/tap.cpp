@@ -0,0 +1,377 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <chrono>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <dirent.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/ptrace.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+}
+
+#include "inject.hpp"
+#include "tap.hpp"
+
+namespace fdinject {
+
+namespace {
+	/// System calls that write to a descriptor given as first argument.
+	constexpr long tapped_syscalls[] = {SYS_write, SYS_pwrite64, SYS_writev, SYS_sendto, SYS_sendmsg};
+
+	constexpr std::size_t tapped_count = sizeof(tapped_syscalls) / sizeof(tapped_syscalls[0]);
+
+	/// Build a filter that returns SECCOMP_RET_TRACE for tapped system calls on fd.
+	std::vector<sock_filter> build_filter(int fd) {
+		std::vector<sock_filter> program;
+		auto statement = [&] (std::uint16_t code, std::uint32_t k) {
+			program.push_back(sock_filter{code, 0, 0, k});
+		};
+		auto jump = [&] (std::uint16_t code, std::uint32_t k, std::uint8_t jt, std::uint8_t jf) {
+			program.push_back(sock_filter{code, jt, jf, k});
+		};
+
+		// Layout: [0] load arch, [1] check arch, [2] load nr, [3..] check nr, load fd, check fd, trace, allow.
+		std::uint8_t const checks = tapped_count;
+		statement(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, arch));
+		jump(BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_X86_64, 0, checks + 4);
+		statement(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, nr));
+		for (std::uint8_t i = 0; i < checks; ++i) {
+			// On match, jump to loading the fd. Otherwise, fall through to the next check, or to allow after the last one.
+			jump(BPF_JMP | BPF_JEQ | BPF_K, tapped_syscalls[i], checks - i - 1, i + 1 == checks ? 3 : 0);
+		}
+		statement(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, args[0]));
+		jump(BPF_JMP | BPF_JEQ | BPF_K, std::uint32_t(fd), 0, 1);
+		statement(BPF_RET | BPF_K, SECCOMP_RET_TRACE);
+		statement(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+		return program;
+	}
+
+	void check(target & target, long result, char const * what) {
+		if (result < 0) throw dbpp::error(target.pid(), {int(-result), std::generic_category()}, what);
+	}
+
+	/// A system call that trapped on entry and waits for its exit.
+	struct pending_call {
+		long number;
+		std::array<dbpp::register_t, 6> arguments;
+	};
+
+	/// Read a memory block from a task, stopping at unreadable memory.
+	void read_block(int tid, std::vector<std::uint8_t> & output, std::uintptr_t address, std::size_t length) {
+		std::size_t offset = output.size();
+		output.resize(offset + length);
+		output.resize(offset + dbpp::read_memory_bulk(tid, output.data() + offset, address, length));
+	}
+
+	/// Read the data written by an iovec array, limited to length bytes.
+	void read_iovec(int tid, std::vector<std::uint8_t> & output, std::uintptr_t iov, std::size_t count, std::size_t length) {
+		std::vector<iovec> vectors(count);
+		vectors.resize(dbpp::read_memory_bulk(tid, vectors.data(), iov, count * sizeof(iovec)) / sizeof(iovec));
+		for (auto const & vector : vectors) {
+			if (!length) break;
+			std::size_t size = std::min(length, vector.iov_len);
+			read_block(tid, output, reinterpret_cast<std::uintptr_t>(vector.iov_base), size);
+			length -= size;
+		}
+	}
+
+	/// Copy the data written by a completed system call.
+	void copy_written(int tid, pending_call const & call, std::size_t written, std::vector<std::uint8_t> & output) {
+		output.clear();
+		switch (call.number) {
+			case SYS_write:
+			case SYS_pwrite64:
+			case SYS_sendto:
+				read_block(tid, output, call.arguments[1], written);
+				break;
+			case SYS_writev:
+				read_iovec(tid, output, call.arguments[1], call.arguments[2], written);
+				break;
+			case SYS_sendmsg: {
+				msghdr message;
+				if (dbpp::read_memory_bulk(tid, &message, call.arguments[1], sizeof(message)) != sizeof(message)) break;
+				read_iovec(tid, output, reinterpret_cast<std::uintptr_t>(message.msg_iov), message.msg_iovlen, written);
+				break;
+			}
+		}
+	}
+
+	/// Restart a system call that was interrupted when the process was stopped.
+	/**
+	 * The kernel only restarts interrupted system calls while handling a signal,
+	 * which does not happen when a process is resumed from the syscall-exit-stop left by injected system calls.
+	 */
+	void restart_interrupted(int pid) {
+		// Internal kernel error codes, see include/linux/errno.h.
+		constexpr long restart_sys = 512, restart_no_intr = 513, restart_no_hand = 514, restart_block = 516;
+
+		dbpp::registers_t registers = dbpp::get_registers(pid);
+		long result = registers.ax;
+		if (long(registers.orig_ax) < 0) return;
+		if (result == -restart_sys || result == -restart_no_intr || result == -restart_no_hand) {
+			registers.ax = registers.orig_ax;
+		} else if (result == -restart_block) {
+			registers.ax = SYS_restart_syscall;
+		} else {
+			return;
+		}
+		registers.ip -= 2;
+		dbpp::set_registers(pid, registers);
+	}
+
+	/// Get the ptrace event of a stop status, or 0.
+	int event(int status) {
+		return status >> 16;
+	}
+
+	/// The ptrace options needed to service the tap filter.
+	constexpr int tap_options = PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACESECCOMP | PTRACE_O_TRACECLONE | PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK;
+
+	/// Get the thread IDs of all tasks of a process.
+	std::vector<int> list_tasks(int pid) {
+		std::vector<int> result;
+		DIR * directory = opendir(("/proc/" + std::to_string(pid) + "/task").c_str());
+		if (!directory) throw dbpp::error(pid, {errno, std::system_category()}, "Failed to list tasks of process");
+		while (dirent * entry = readdir(directory)) {
+			char * end;
+			long tid = std::strtol(entry->d_name, &end, 10);
+			if (!*end && tid > 0) result.push_back(tid);
+		}
+		closedir(directory);
+		return result;
+	}
+
+	/// Check if a stop is a group-stop, as opposed to the initial stop of a new task or a PTRACE_INTERRUPT.
+	bool is_group_stop(int status) {
+		if (event(status) != PTRACE_EVENT_STOP) return false;
+		int signal = WSTOPSIG(status);
+		return signal == SIGSTOP || signal == SIGTSTP || signal == SIGTTIN || signal == SIGTTOU;
+	}
+}
+
+namespace {
+	/// Wait for a state change of one of our own tasks, leaving the events of other children to the application.
+	/**
+	 * The next event is peeked at with WNOWAIT and only consumed if it belongs to one of our tasks.
+	 * While an event of another child is pending, our tasks are polled with WNOHANG instead.
+	 * \return The thread ID of the task, or -1 if there are no children left at all.
+	 */
+	int wait_own(int pid, std::set<int> const & own, int & status) {
+		constexpr std::chrono::microseconds min_poll_interval{10};
+		constexpr std::chrono::microseconds max_poll_interval{1000};
+		std::chrono::microseconds interval = min_poll_interval;
+
+		while (true) {
+			siginfo_t info;
+			info.si_pid = 0;
+			if (waitid(P_ALL, 0, &info, WEXITED | WSTOPPED | WNOWAIT | __WALL) != 0) {
+				if (errno == EINTR) continue;
+				if (errno == ECHILD) return -1;
+				throw dbpp::error(pid, {errno, std::system_category()}, "Failed to wait for traced process");
+			}
+
+			if (own.count(info.si_pid)) {
+				while (true) {
+					int tid = waitpid(info.si_pid, &status, __WALL);
+					if (tid >= 0) return tid;
+					if (errno != EINTR) throw dbpp::error(info.si_pid, {errno, std::system_category()}, "Failed to wait for traced process");
+				}
+			}
+
+			for (int tid : own) {
+				if (waitpid(tid, &status, WNOHANG | __WALL) > 0) return tid;
+			}
+			std::this_thread::sleep_for(interval);
+			interval = std::min(interval * 2, max_poll_interval);
+		}
+	}
+}
+
+/// Attach to all other tasks of a process with the options needed by run_tap().
+std::vector<int> seize_tasks(int pid, std::ostream * log) {
+	std::vector<int> seized;
+	try {
+		// Tasks may be created while attaching, so repeat until no new ones show up.
+		bool found = true;
+		while (found) {
+			found = false;
+			for (int tid : list_tasks(pid)) {
+				if (tid == pid || std::find(seized.begin(), seized.end(), tid) != seized.end()) continue;
+				try {
+					dbpp::attach(tid, tap_options);
+				} catch (dbpp::error const & e) {
+					// The task exited in the meantime, or it was created by a task we already trace.
+					if (e.code() == std::errc::no_such_process || e.code() == std::errc::operation_not_permitted) continue;
+					throw;
+				}
+				seized.push_back(tid);
+				found = true;
+			}
+		}
+	} catch (...) {
+		release_tasks(seized);
+		throw;
+	}
+	if (log && !seized.empty()) *log << "Attached to " << seized.size() << " other tasks of process " << pid << ".\n";
+	return seized;
+}
+
+/// Detach from tasks attached by seize_tasks().
+void release_tasks(std::vector<int> const & tasks) {
+	for (int tid : tasks) {
+		// A running task must be stopped before it can be detached. Tasks that exited in the meantime are skipped.
+		if (ptrace(PTRACE_INTERRUPT, tid, nullptr, nullptr)) continue;
+		int status;
+		while (waitpid(tid, &status, __WALL) < 0 && errno == EINTR);
+		ptrace(PTRACE_DETACH, tid, nullptr, nullptr);
+	}
+}
+
+/// Install a seccomp filter in a stopped target that makes writes to a descriptor trap to the tracer.
+void install_tap_filter(target & target, int fd, bool no_new_privs, std::ostream * log) {
+	std::vector<sock_filter> program = build_filter(fd);
+	std::size_t program_size = program.size() * sizeof(sock_filter);
+	std::size_t mapping_size = sizeof(sock_fprog) + program_size;
+
+	long address = mmap(target, 0, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, 0, 0);
+	check(target, address, "Failed to allocate memory in process");
+
+	try {
+		sock_fprog header;
+		header.len    = program.size();
+		header.filter = reinterpret_cast<sock_filter *>(address + sizeof(sock_fprog));
+		target.copy_to(address, &header, sizeof(header));
+		target.copy_to(address + sizeof(sock_fprog), program.data(), program_size);
+
+		// Synchronize all threads of the process to the new filter, so writes from other threads trap as well.
+		long result = target.syscall(SYS_seccomp, {{SECCOMP_SET_MODE_FILTER, SECCOMP_FILTER_FLAG_TSYNC, std::uintptr_t(address), 0, 0, 0}});
+		if (result == -EACCES && no_new_privs) {
+			if (log) *log << "Setting no_new_privs in target to install seccomp filter.\n";
+			check(target, target.syscall(SYS_prctl, {{PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0, 0}}), "Failed to execute prctl system call in traced process");
+			result = target.syscall(SYS_seccomp, {{SECCOMP_SET_MODE_FILTER, SECCOMP_FILTER_FLAG_TSYNC, std::uintptr_t(address), 0, 0, 0}});
+		} else if (result == -EACCES) {
+			throw dbpp::error(target.pid(), {EACCES, std::generic_category()}, "Installing a seccomp filter requires CAP_SYS_ADMIN in the traced process or permission to set no_new_privs in it");
+		}
+		if (result > 0) throw dbpp::error(target.pid(), {ESRCH, std::generic_category()}, "Failed to synchronize seccomp filter to thread " + std::to_string(result) + " of traced process");
+		check(target, result, "Failed to execute seccomp system call in traced process");
+	} catch (...) {
+		munmap(target, address, mapping_size);
+		throw;
+	}
+
+	check(target, munmap(target, address, mapping_size), "Failed to deallocate memory in process");
+	if (log) *log << "Installed seccomp filter for descriptor " << fd << ".\n";
+}
+
+/// Trace a stopped process with a tap filter until all its tasks have exited.
+tap_stats run_tap(int pid, std::vector<int> const & tasks, extract_sink const & sink, std::atomic<bool> const & stop, std::ostream * log) {
+	dbpp::set_options(pid, tap_options);
+	restart_interrupted(pid);
+	dbpp::resume(pid);
+
+	tap_stats stats;
+	std::map<int, pending_call> pending;
+	std::vector<std::uint8_t> buffer;
+	std::set<int> own(tasks.begin(), tasks.end());
+	own.insert(pid);
+
+	while (!own.empty()) {
+		int status;
+		int tid = wait_own(pid, own, status);
+		if (tid < 0) break;
+
+		if (WIFEXITED(status) || WIFSIGNALED(status)) {
+			pending.erase(tid);
+			own.erase(tid);
+			continue;
+		}
+		if (!WIFSTOPPED(status)) continue;
+
+		int signal = WSTOPSIG(status);
+		try {
+			if (signal == SIGTRAP && event(status) == PTRACE_EVENT_SECCOMP) {
+				// Entry of a tapped system call: wait for its exit to know how much was written.
+				dbpp::registers_t registers = dbpp::get_registers(tid);
+				pending[tid] = pending_call{long(registers.orig_ax), {{registers.di, registers.si, registers.dx, registers.r10, registers.r8, registers.r9}}};
+				dbpp::step_syscall(tid);
+				continue;
+			}
+
+			if (signal == (SIGTRAP | 0x80)) {
+				// Exit of a tapped system call.
+				auto call = pending.find(tid);
+				if (call != pending.end()) {
+					long result = dbpp::get_registers(tid).ax;
+					++stats.calls;
+					if (result > 0 && !stop) {
+						copy_written(tid, call->second, result, buffer);
+						sink(buffer.data(), buffer.size());
+						stats.bytes += buffer.size();
+					}
+					pending.erase(call);
+				}
+				dbpp::resume(tid);
+				continue;
+			}
+
+			if (signal == SIGTRAP && (event(status) == PTRACE_EVENT_CLONE || event(status) == PTRACE_EVENT_FORK || event(status) == PTRACE_EVENT_VFORK)) {
+				// The new task is traced automatically and reports its own stop.
+				unsigned long new_tid = 0;
+				if (ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &new_tid) == 0) own.insert(new_tid);
+				if (log) *log << "Tracing new task " << new_tid << " of process " << tid << ".\n";
+				dbpp::resume(tid);
+				continue;
+			}
+
+			// Group stops keep the task stopped until SIGCONT, initial stops of new tasks are resumed, other signals are delivered.
+			if (is_group_stop(status)) {
+				dbpp::listen(tid);
+			} else if (event(status) == PTRACE_EVENT_STOP || signal == SIGTRAP) {
+				dbpp::resume(tid);
+			} else {
+				dbpp::resume(tid, signal);
+			}
+		} catch (dbpp::error const & e) {
+			// The task may have been killed while it was stopped. Its exit is reported by waitpid.
+			if (e.code() != std::errc::no_such_process) throw;
+		}
+	}
+
+	return stats;
+}
+
+}
@@ -0,0 +1,90 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "extract.hpp"
+#include "target.hpp"
+
+namespace fdinject {
+
+/// Statistics of a tap.
+struct tap_stats {
+	/// The number of system calls that trapped.
+	std::uint64_t calls = 0;
+
+	/// The number of bytes passed to the sink.
+	std::uint64_t bytes = 0;
+};
+
+/// Attach to all other tasks of a process with the options needed by run_tap().
+/**
+ * The filter is installed in all threads of the process, so all of them must be traced before it is installed.
+ * The main thread must already be attached by the caller. The other tasks keep running.
+ * \return The thread IDs of the tasks attached to.
+ *
+ * Throws on failure.
+ */
+std::vector<int> seize_tasks(int pid, std::ostream * log = nullptr);
+
+/// Detach from tasks attached by seize_tasks(), ignoring tasks that exited.
+void release_tasks(std::vector<int> const & tasks);
+
+/// Install a seccomp filter in a stopped target that makes writes to a descriptor trap to the tracer.
+/**
+ * The filter matches write, pwrite64, writev, sendto and sendmsg on the descriptor and allows everything else,
+ * so unrelated system calls do not stop the target.
+ * It is installed with SECCOMP_FILTER_FLAG_TSYNC, so it applies to all threads of the target.
+ *
+ * Without CAP_SYS_ADMIN, a process can only install a filter after setting no_new_privs, which can not be unset either.
+ * If no_new_privs is true, it is set in the target when needed. Otherwise, installing the filter fails.
+ *
+ * A seccomp filter can not be removed again.
+ * Once the filter is installed, matching system calls fail with ENOSYS if the process is not traced with PTRACE_O_TRACESECCOMP,
+ * so the caller must keep tracing the process with run_tap() until it exits.
+ *
+ * Throws on failure.
+ */
+void install_tap_filter(target & target, int fd, bool no_new_privs = false, std::ostream * log = nullptr);
+
+/// Trace a stopped process with a tap filter and pass the written data to a sink, until all its tasks have exited.
+/**
+ * The process must be stopped, and all its other tasks must be attached with seize_tasks(),
+ * which returns the tasks to pass as tasks.
+ * Only state changes of these tasks and of tasks they create are consumed,
+ * so other children of the calling process can still be waited for by the application.
+ *
+ * New threads and child processes inherit the filter, so they are traced as well.
+ * Group-stops are left in place with PTRACE_LISTEN, so job control keeps working.
+ * The data of each matching system call is passed to the sink after the call completed,
+ * limited to the number of bytes actually written.
+ *
+ * Once stop becomes true, the sink is no longer called,
+ * but matching system calls are still serviced so they keep working.
+ *
+ * Throws on failure.
+ */
+tap_stats run_tap(int pid, std::vector<int> const & tasks, extract_sink const & sink, std::atomic<bool> const & stop, std::ostream * log = nullptr);
+
+}
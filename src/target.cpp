@@ -0,0 +1,84 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cerrno>
+#include <cstring>
+
+extern "C" {
+#include <unistd.h>
+}
+
+#include "record.hpp"
+#include "syscall.hpp"
+#include "target.hpp"
+
+namespace fdinject {
+
+long traced_target::syscall(long number, std::array<dbpp::register_t, 6> const & arguments) {
+	return dbpp::syscall(pid_, number, arguments, deadline_);
+}
+
+void traced_target::copy_to(std::uintptr_t destination, void const * source, std::size_t count) {
+	dbpp::memcpy_to(pid_, destination, source, count);
+}
+
+void traced_target::copy_from(void * destination, std::uintptr_t source, std::size_t count) {
+	// Fall back to ptrace for the remainder, so unreadable memory results in a proper error.
+	std::size_t copied = dbpp::read_memory_bulk(pid_, destination, source, count);
+	if (copied < count) dbpp::memcpy_from(pid_, static_cast<std::uint8_t *>(destination) + copied, source + copied, count - copied);
+}
+
+int local_target::pid() const {
+	return getpid();
+}
+
+long local_target::syscall(long number, std::array<dbpp::register_t, 6> const & arguments) {
+	long result = ::syscall(number, arguments[0], arguments[1], arguments[2], arguments[3], arguments[4], arguments[5]);
+	if (result == -1) return -errno;
+	return result;
+}
+
+void local_target::copy_to(std::uintptr_t destination, void const * source, std::size_t count) {
+	std::memcpy(reinterpret_cast<void *>(destination), source, count);
+}
+
+void local_target::copy_from(void * destination, std::uintptr_t source, std::size_t count) {
+	std::memcpy(destination, reinterpret_cast<void const *>(source), count);
+}
+
+long recording_target::syscall(long number, std::array<dbpp::register_t, 6> const & arguments) {
+	auto start  = recorder::clock::now();
+	long result = inner.syscall(number, arguments);
+	recorder_.syscall(number, arguments, result, start, recorder::clock::now());
+	return result;
+}
+
+void recording_target::copy_to(std::uintptr_t destination, void const * source, std::size_t count) {
+	auto start = recorder::clock::now();
+	inner.copy_to(destination, source, count);
+	recorder_.copy(record_type::copy_to, destination, count, start, recorder::clock::now());
+}
+
+void recording_target::copy_from(void * destination, std::uintptr_t source, std::size_t count) {
+	auto start = recorder::clock::now();
+	inner.copy_from(destination, source, count);
+	recorder_.copy(record_type::copy_from, source, count, start, recorder::clock::now());
+}
+
+}
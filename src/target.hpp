@@ -0,0 +1,105 @@
+/*
+  Copyright 2014 Maarten de Vries <maarten@de-vri.es>
+  https://github.com/de-vri-es/fdinject/
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "dbpp.hpp"
+
+namespace fdinject {
+
+class recorder;
+
+/// A process that the injection engine makes system calls in.
+class target {
+public:
+	virtual ~target() {}
+
+	/// The process ID, used to look up information in /proc.
+	virtual int pid() const = 0;
+
+	/// Make the process perform a system call.
+	/**
+	 * \return The raw result of the system call, which is a negative error number on failure.
+	 * Throws if the system call could not be performed.
+	 */
+	virtual long syscall(long number, std::array<dbpp::register_t, 6> const & arguments) = 0;
+
+	/// Copy a block of memory to the process.
+	/**
+	 * Throws on failure.
+	 */
+	virtual void copy_to(std::uintptr_t destination, void const * source, std::size_t count) = 0;
+
+	/// Copy a block of memory from the process.
+	/**
+	 * Throws on failure.
+	 */
+	virtual void copy_from(void * destination, std::uintptr_t source, std::size_t count) = 0;
+};
+
+/// A stopped process traced with ptrace.
+class traced_target : public target {
+public:
+	explicit traced_target(int pid) : pid_(pid), deadline_(dbpp::deadline_t::max()) {}
+
+	/// Set the deadline for system calls made in the process.
+	/**
+	 * A system call that misses the deadline throws dbpp::deadline_exceeded, see dbpp::syscall().
+	 */
+	void set_deadline(dbpp::deadline_t deadline) { deadline_ = deadline; }
+
+	int pid() const override { return pid_; }
+	long syscall(long number, std::array<dbpp::register_t, 6> const & arguments) override;
+	void copy_to(std::uintptr_t destination, void const * source, std::size_t count) override;
+	void copy_from(void * destination, std::uintptr_t source, std::size_t count) override;
+
+private:
+	int pid_;
+	dbpp::deadline_t deadline_;
+};
+
+/// The calling process itself, used as stand-in target when replaying sessions.
+class local_target : public target {
+public:
+	int pid() const override;
+	long syscall(long number, std::array<dbpp::register_t, 6> const & arguments) override;
+	void copy_to(std::uintptr_t destination, void const * source, std::size_t count) override;
+	void copy_from(void * destination, std::uintptr_t source, std::size_t count) override;
+};
+
+/// A target that records all system calls and memory copies of another target.
+class recording_target : public target {
+public:
+	recording_target(target & inner, recorder & recorder) : inner(inner), recorder_(recorder) {}
+
+	int pid() const override { return inner.pid(); }
+	long syscall(long number, std::array<dbpp::register_t, 6> const & arguments) override;
+	void copy_to(std::uintptr_t destination, void const * source, std::size_t count) override;
+	void copy_from(void * destination, std::uintptr_t source, std::size_t count) override;
+
+private:
+	target & inner;
+	recorder & recorder_;
+};
+
+}